@@ -0,0 +1,351 @@
+/* ============================================================
+ *
+ * This file is a part of digiKam flow plugin project
+ * https://github.com/cathaysia/digikamflowplugin
+ *
+ * Date        : 2021-05-22
+ * Description : Headless benchmark of PicDialog loading, layout and scrolling.
+ *
+ * Copyright (C) 2021-2022 by DragonBillow <DragonBillow at outlook dot com>
+ *
+ * Redistribution and use is allowed according to the terms of the GPL3 license.
+ * For details see the accompanying LICENSE file.
+ *
+ * ============================================================ */
+
+/**
+ * flowbench fills a PicDialog with a synthetic album and prints one JSON object,
+ * including the per-step timings of Profiler:
+ *
+ *   flowbench --loader custom --count 200
+ *   flowbench --loader digikam --virtualized --corpus ~/Pictures/album
+ *   flowbench --painted --count 5000
+ *   flowbench --twin --count 200
+ *   flowbench --generate /tmp/album --count 1000
+ *
+ * Run it with QT_QPA_PLATFORM=offscreen on machines without a display. Every run
+ * measures one loader in a fresh process, and the synthetic album is rendered by
+ * a child process, so the peak RSS belongs to that loader.
+ */
+
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QImage>
+#include <QImageReader>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLinearGradient>
+#include <QPainter>
+#include <QProcess>
+#include <QRandomGenerator>
+#include <QScrollArea>
+#include <QScrollBar>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QTimer>
+
+#include <algorithm>
+#include <iterator>
+
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#endif
+
+#include "albumindex.hpp"
+#include "decodecache.hpp"
+#include "dinfointerface.h"
+#include "picdialog.hpp"
+#include "profiler.hpp"
+#include "resampler.hpp"
+#include "tileinfo.hpp"
+
+using namespace Digikam;
+
+namespace {
+
+constexpr int kFrameInterval = 16;
+
+/**
+ * Answers itemInfo() like digikam's database does, so the tiles are placed
+ * from the known dimensions instead of the image headers.
+ */
+class StubInfoInterface : public DInfoInterface {
+public:
+    explicit StubInfoInterface(QObject* parent = nullptr)
+        : DInfoInterface(parent) { }
+
+    void insert(QUrl const& url, QSize const& size) {
+        sizes_.insert(url, size);
+    }
+
+    QList<QUrl> currentAlbumItems() const override {
+        return sizes_.keys();
+    }
+
+    DInfoMap itemInfo(QUrl const& url) const override {
+        DInfoMap map;
+        if(!sizes_.contains(url)) return map;
+        map.insert(QLatin1String("dimensions"), sizes_.value(url));
+        map.insert(QLatin1String("orientation"), 1);
+        return map;
+    }
+
+private:
+    QMap<QUrl, QSize> sizes_;
+};
+
+// Pictures of common aspect ratios, with enough detail that jpeg has to work for them
+void generateCorpus(QString const& dir, int count) {
+    static QSize const ratios[] = { { 4, 3 }, { 3, 2 }, { 16, 9 }, { 1, 1 }, { 2, 3 }, { 3, 4 } };
+
+    QRandomGenerator rng(20210522);
+    for(int i = 0; i < count; ++i) {
+        QSize ratio = ratios[rng.bounded(int(std::size(ratios)))];
+        int   width = rng.bounded(1200, 4000);
+        QSize size(width, width * ratio.height() / ratio.width());
+
+        QImage          img(size, QImage::Format_RGB32);
+        QPainter        painter(&img);
+        QLinearGradient gradient(0, 0, size.width(), size.height());
+        gradient.setColorAt(0, QColor::fromRgb(rng.generate()));
+        gradient.setColorAt(1, QColor::fromRgb(rng.generate()));
+        painter.fillRect(img.rect(), gradient);
+        for(int j = 0; j < 64; ++j) {
+            QRect rect(rng.bounded(size.width()), rng.bounded(size.height()), rng.bounded(1, size.width() / 4),
+                       rng.bounded(1, size.height() / 4));
+            painter.fillRect(rect, QColor::fromRgb(rng.generate()));
+        }
+        painter.end();
+
+        QString path = QDir(dir).filePath(QString::asprintf("bench_%05d.jpg", i));
+        img.save(path, "JPEG", 90);
+    }
+}
+
+QList<QUrl> listCorpus(QString const& dir) {
+    QStringList filters;
+    for(auto& format: QImageReader::supportedImageFormats()) filters << QStringLiteral("*.") + format;
+
+    QList<QUrl> urls;
+    for(auto& name: QDir(dir).entryList(filters, QDir::Files, QDir::Name))
+        urls.append(QUrl::fromLocalFile(QDir(dir).filePath(name)));
+    return urls;
+}
+
+// in KB
+qint64 peakRss() {
+#ifdef Q_OS_UNIX
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef Q_OS_MACOS
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+#else
+    return -1;
+#endif
+}
+
+QJsonObject frameStats(QVector<double> frames) {
+    QJsonObject stats;
+    stats["count"] = frames.count();
+    if(frames.isEmpty()) return stats;
+
+    std::sort(frames.begin(), frames.end());
+    double sum = 0;
+    for(auto frame: frames) sum += frame;
+    auto percentile = [&frames](double p) {
+        return frames.at(std::min(int(p * frames.count()), frames.count() - 1));
+    };
+    stats["mean_ms"] = sum / frames.count();
+    stats["p50_ms"]  = percentile(0.50);
+    stats["p95_ms"]  = percentile(0.95);
+    stats["max_ms"]  = frames.last();
+    stats["over_budget"] =
+        int(std::count_if(frames.cbegin(), frames.cend(), [](double frame) { return frame > kFrameInterval; }));
+    return stats;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    QApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Benchmark the Flow View dialog without digikam");
+    parser.addHelpOption();
+    // clang-format off
+    parser.addOptions({
+        { "loader", "custom or digikam.", "loader", "custom" },
+        { "count", "Pictures of the synthetic album.", "count", "200" },
+        { "corpus", "Use the pictures of a directory instead of a synthetic album.", "dir" },
+        { "virtualized", "Only create widgets for visible tiles." },
+        { "painted", "Paint all tiles in one widget, implies --virtualized." },
+        { "style", "Row, Col or Square.", "style", "Col" },
+        { "width", "Width of the dialog.", "pixels", "1280" },
+        { "height", "Height of the dialog.", "pixels", "800" },
+        { "ref-width", "Reference width of the tiles.", "pixels", "300" },
+        { "disk-cache", "Disk cache of custom loader in MB, 0 disables it.", "mb", "1024" },
+        { "read-threads", "Read threads of custom loader, 0 is automatic.", "count", "0" },
+        { "decode-threads", "Decode threads of custom loader, 0 is automatic.", "count", "0" },
+        { "depth", "Pipeline depth of custom loader.", "count", "8" },
+        { "idle", "Loading is over when no tile arrived for this long.", "ms", "3000" },
+        { "timeout", "Give up loading after this long.", "ms", "300000" },
+        { "trace", "Write the Chrome trace of the run to a file.", "file" },
+        { "album-index", "Place the tiles from the album index of --corpus, run twice to measure a warm start." },
+        { "twin", "Load the album in a second dialog at the same time, both share the decode cache." },
+        { "generate", "Write the synthetic album to a directory and exit, measure it with --corpus.", "dir" },
+    });
+    // clang-format on
+    parser.process(app);
+
+    if(parser.isSet("generate")) {
+        QDir().mkpath(parser.value("generate"));
+        generateCorpus(parser.value("generate"), parser.value("count").toInt());
+        return 0;
+    }
+
+    bool custom = parser.value("loader") != QLatin1String("digikam");
+    Profiler::instance()->setEnabled(true);
+
+    StubInfoInterface iface;
+    QTemporaryDir     tmp;
+    QList<QUrl>       urls;
+    if(parser.isSet("corpus")) {
+        urls = listCorpus(parser.value("corpus"));
+    } else {
+        // rendering the album takes far more memory than loading it, it must not count in the peak RSS
+        QStringList args { QStringLiteral("--generate"), tmp.path(), QStringLiteral("--count"), parser.value("count") };
+        QProcess::execute(QCoreApplication::applicationFilePath(), args);
+        urls = listCorpus(tmp.path());
+        // the dimensions are known like in digikam's database, the headers are not read
+        for(auto& url: urls) iface.insert(url, QImageReader(url.toLocalFile()).size());
+    }
+
+    // shared by the dialogs like FlowPlugin does
+    QSharedPointer<DecodeCache> decodeCache(new DecodeCache);
+
+    auto newDialog = [&]() {
+        auto* dialog = new PicDialog(nullptr, parser.isSet("virtualized"), parser.isSet("painted"));
+        dialog->setAttribute(Qt::WA_DeleteOnClose, false);
+        dialog->setSpacing(3);
+        dialog->setReferenceWidth(parser.value("ref-width").toInt());
+        dialog->setStyle(parser.value("style"));
+        dialog->setDiskCacheSize(parser.value("disk-cache").toInt());
+        dialog->setReadThreads(parser.value("read-threads").toInt());
+        dialog->setDecodeThreads(parser.value("decode-threads").toInt());
+        dialog->setPipelineDepth(parser.value("depth").toInt());
+        dialog->setDecodeCache(decodeCache);
+        dialog->resize(parser.value("width").toInt(), parser.value("height").toInt());
+        dialog->show();
+        return dialog;
+    };
+    auto* dialog = newDialog();
+    auto* twin   = parser.isSet("twin") ? newDialog() : nullptr;
+
+    QElapsedTimer clock;
+    qint64        firstTile = -1;
+    qint64        lastTile  = -1;
+    int           loaded    = 0;
+    bool          loading   = true;
+    QEventLoop    loop;
+    QTimer        idle;
+    idle.setSingleShot(true);
+    idle.setInterval(parser.value("idle").toInt());
+    QObject::connect(&idle, &QTimer::timeout, &loop, &QEventLoop::quit);
+    QObject::connect(dialog, &PicDialog::tileLoaded, [&](int) {
+        lastTile = clock.elapsed();
+        if(firstTile < 0) firstTile = lastTile;
+        if(++loaded >= urls.count() && loading) loop.quit();
+        idle.start();
+    });
+
+    // same as FlowPlugin::flowView()
+    clock.start();
+    AlbumIndex index(parser.isSet("album-index") && parser.isSet("corpus")
+                         ? QStringLiteral("flowbench:") + QDir(parser.value("corpus")).absolutePath()
+                         : QString());
+    QObject::connect(&index, &AlbumIndex::changed, dialog, &PicDialog::updateTile);
+    for(auto& url: urls) {
+        TileInfo info;
+        if(!index.find(url, info)) info = TileInfo::fromInfoMap(url, iface.itemInfo(url));
+        index.append(info);
+        dialog->load(info, custom);
+        if(twin) twin->load(info, custom);
+    }
+    qint64 placed = clock.elapsed();
+    index.reconcile();
+
+    idle.start();
+    QTimer::singleShot(parser.value("timeout").toInt(), &loop, &QEventLoop::quit);
+    if(loaded < urls.count()) loop.exec();
+    loading                = false;
+    int loadedBeforeScroll = loaded;
+    int passesBeforeScroll = dialog->layoutPasses();
+
+    // scroll a quarter of the viewport per frame, from top to bottom
+    auto*           area = dialog->findChild<QScrollArea*>();
+    auto*           bar  = area->verticalScrollBar();
+    QVector<double> frames;
+    QTimer          ticker;
+    ticker.setInterval(kFrameInterval);
+    QObject::connect(&ticker, &QTimer::timeout, [&]() {
+        if(bar->value() >= bar->maximum()) return loop.quit();
+        QElapsedTimer frame;
+        frame.start();
+        bar->setValue(bar->value() + std::max(area->viewport()->height() / 4, 1));
+        QCoreApplication::processEvents();
+        area->viewport()->repaint();
+        frames.append(frame.nsecsElapsed() / 1e6);
+    });
+    idle.stop();
+    ticker.start();
+    loop.exec();
+    ticker.stop();
+
+    QJsonObject result;
+    result["loader"]                  = custom ? "custom" : "digikam";
+    result["virtualized"]             = parser.isSet("virtualized");
+    result["painted"]                 = parser.isSet("painted");
+    result["style"]                   = parser.value("style");
+    result["images"]                  = urls.count();
+    result["placement_ms"]            = placed;
+    result["time_to_first_tile_ms"]   = firstTile;
+    result["time_to_all_tiles_ms"]    = lastTile;
+    result["tiles_loaded"]            = loadedBeforeScroll;
+    result["tiles_loaded_total"]      = loaded;
+    result["layout_passes"]           = passesBeforeScroll;
+    result["layout_passes_per_image"] = urls.isEmpty() ? 0. : double(passesBeforeScroll) / urls.count();
+    result["scroll_frames"]           = frameStats(frames);
+    result["peak_rss_kb"]             = peakRss();
+    result["resampler"]               = Resampler::kernel();
+
+    auto shared            = decodeCache->stats();
+    result["decode_cache"] = QJsonObject {
+        { "decoded", shared.decodes },
+        { "cached", shared.hits },
+        { "joined", shared.joins },
+    };
+
+    QJsonObject steps;
+    auto        stats = Profiler::instance()->stats();
+    for(auto it = stats.cbegin(); it != stats.cend(); ++it) {
+        steps[it.key()] = QJsonObject {
+            { "count", it->count },
+            { "mean_ms", it->total / 1000. / it->count },
+            { "max_ms", it->max / 1000. },
+        };
+    }
+    result["steps"] = steps;
+    if(parser.isSet("trace")) Profiler::instance()->exportTrace(parser.value("trace"));
+
+    QTextStream(stdout) << QJsonDocument(result).toJson(QJsonDocument::Indented);
+
+    delete twin;
+    delete dialog;
+    return 0;
+}
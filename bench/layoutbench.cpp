@@ -0,0 +1,167 @@
+/* ============================================================
+ *
+ * This file is a part of digiKam flow plugin project
+ * https://github.com/cathaysia/digikamflowplugin
+ *
+ * Date        : 2021-05-22
+ * Description : Microbenchmark of TileLayout and JustifiedLayout.
+ *
+ * Copyright (C) 2021-2022 by DragonBillow <DragonBillow at outlook dot com>
+ *
+ * Redistribution and use is allowed according to the terms of the GPL3 license.
+ * For details see the accompanying LICENSE file.
+ *
+ * ============================================================ */
+
+/**
+ * layoutbench lays out synthetic albums of 1k, 10k and 100k pictures in every
+ * style and prints one JSON object:
+ *
+ *   layoutbench --width 1280 --ref-width 300 --runs 20
+ *
+ * "full_ms" is a layout from scratch, "append_ms" appending one picture to a
+ * laid out album. For Row, "row_deviation" is the mean of |row height -
+ * reference| / reference, next to the one of a greedy fill for comparison.
+ */
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRandomGenerator>
+#include <QTextStream>
+
+#include <algorithm>
+#include <iterator>
+
+#include "justifiedlayout.hpp"
+#include "tilelayout.hpp"
+
+namespace {
+
+QVector<QSize> makeSizes(int count) {
+    static QSize const ratios[] = { { 4, 3 }, { 3, 2 }, { 16, 9 }, { 1, 1 }, { 2, 3 }, { 3, 4 } };
+
+    QRandomGenerator rng(20210522);
+    QVector<QSize>   sizes;
+    sizes.reserve(count);
+    for(int i = 0; i < count; ++i) {
+        QSize ratio = ratios[rng.bounded(int(std::size(ratios)))];
+        sizes.append(ratio * 1000);
+    }
+    return sizes;
+}
+
+double median(QVector<double> values) {
+    std::sort(values.begin(), values.end());
+    return values.isEmpty() ? 0 : values.at(values.count() / 2);
+}
+
+// rows filled at the reference height until they are wider than the width, what Row did before
+double greedyDeviation(QVector<QSize> const& sizes, int width, int spacing, qreal ref) {
+    double sum  = 0;
+    int    rows = 0;
+    int    i    = 0;
+    while(i < sizes.count()) {
+        qreal ratios = 0;
+        int   begin  = i;
+        for(; i < sizes.count(); ++i) {
+            ratios += qreal(sizes.at(i).width()) / sizes.at(i).height();
+            if(ratios * ref + spacing * (i - begin) >= width) {
+                ++i;
+                break;
+            }
+        }
+        int gaps = spacing * (i - begin - 1);
+        if(ratios * ref + gaps < width) break;
+        sum += qAbs((width - gaps) / ratios - ref) / ref;
+        ++rows;
+    }
+    return rows ? sum / rows : 0;
+}
+
+double rowDeviation(TileLayout const& layout, qreal ref) {
+    double sum  = 0;
+    int    rows = 0;
+    int    top  = -1;
+    for(int i = 0; i < layout.count(); ++i) {
+        QRect rect = layout.rect(i);
+        if(rect.y() == top) continue;
+        top = rect.y();
+        sum += qAbs(rect.height() - ref) / ref;
+        ++rows;
+    }
+    return rows ? sum / rows : 0;
+}
+
+}    // namespace
+
+int main(int argc, char* argv[]) {
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Benchmark the tile layouts");
+    parser.addHelpOption();
+    // clang-format off
+    parser.addOptions({
+        { "width", "Width of the view.", "pixels", "1280" },
+        { "ref-width", "Reference width of the tiles.", "pixels", "300" },
+        { "spacing", "Spacing between the tiles.", "pixels", "3" },
+        { "runs", "Runs of every measure, the median is printed.", "count", "20" },
+    });
+    // clang-format on
+    parser.process(app);
+
+    int   width   = parser.value("width").toInt();
+    qreal ref     = parser.value("ref-width").toDouble();
+    int   spacing = parser.value("spacing").toInt();
+    int   runs    = std::max(parser.value("runs").toInt(), 1);
+
+    QJsonArray results;
+    for(int count: { 1000, 10000, 100000 }) {
+        QVector<QSize> sizes = makeSizes(count);
+        for(auto style: { TileLayout::Style::Row, TileLayout::Style::Col, TileLayout::Style::Square }) {
+            QVector<double> full, append;
+            TileLayout      layout;
+            for(int run = 0; run < runs; ++run) {
+                layout.clear();
+                layout.setStyle(style);
+                layout.setWidth(width);
+                layout.setReferenceWidth(ref);
+                layout.setSpacing(spacing);
+
+                QElapsedTimer timer;
+                timer.start();
+                for(auto& size: sizes) layout.append(size);
+                layout.update();
+                full.append(timer.nsecsElapsed() / 1e6);
+
+                timer.restart();
+                layout.append(sizes.first());
+                layout.update();
+                append.append(timer.nsecsElapsed() / 1e6);
+            }
+
+            char const* name = style == TileLayout::Style::Row   ? "Row"
+                               : style == TileLayout::Style::Col ? "Col"
+                                                                 : "Square";
+            QJsonObject result {
+                { "count", count },
+                { "style", name },
+                { "full_ms", median(full) },
+                { "append_ms", median(append) },
+                { "height", layout.height() },
+            };
+            if(style == TileLayout::Style::Row) {
+                result["row_deviation"]        = rowDeviation(layout, ref);
+                result["greedy_row_deviation"] = greedyDeviation(sizes, width, spacing, ref);
+            }
+            results.append(result);
+        }
+    }
+
+    QTextStream(stdout) << QJsonDocument(results).toJson(QJsonDocument::Indented);
+    return 0;
+}
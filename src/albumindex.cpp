@@ -0,0 +1,192 @@
+/* ============================================================
+ *
+ * This file is a part of digiKam flow plugin project
+ * https://github.com/cathaysia/digikamflowplugin
+ *
+ * Date        : 2021-05-22
+ * Description : Per album index of the tiles, kept between sessions.
+ *
+ * Copyright (C) 2021-2022 by DragonBillow <DragonBillow at outlook dot com>
+ *
+ * Redistribution and use is allowed according to the terms of the GPL3 license.
+ * For details see the accompanying LICENSE file.
+ *
+ * ============================================================ */
+
+#include "albumindex.hpp"
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QFutureWatcher>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QtConcurrent>
+
+#include <algorithm>
+#include <cstring>
+
+#include "digikam_debug.h"
+#include "profiler.hpp"
+
+namespace {
+
+struct Header {
+    quint32 magic;
+    quint32 version;
+    qint32  count;
+    qint32  reserved;
+};
+
+// followed by pathLength bytes of UTF-8
+struct Entry {
+    qint64 modified;
+    qint64 bytes;
+    qint32 width;
+    qint32 height;
+    qint32 orientation;
+    qint32 pathLength;
+};
+
+constexpr quint32 kMagic   = 0x49415646;    // "FVAI"
+constexpr quint32 kVersion = 1;
+
+struct Update {
+    int      position;
+    TileInfo info;
+    bool     changed;
+};
+
+bool sameTile(TileInfo const& a, TileInfo const& b) {
+    return a.url == b.url && a.size == b.size && a.orientation == b.orientation && a.modified == b.modified
+           && a.bytes == b.bytes;
+}
+
+// runs on a worker thread, pictures without a stamp only get one
+QVector<Update> checkFiles(QVector<TileInfo> items) {
+    Profiler::Scope scope("reconcile");
+    QVector<Update> updates;
+    for(int i = 0; i < items.count(); ++i) {
+        TileInfo fresh = items.at(i);
+        fresh.stamp();
+        if(fresh.modified < 0) continue;
+        if(items.at(i).modified < 0 || items.at(i).bytes < 0) {
+            updates.append(Update { i, fresh, false });
+        } else if(fresh.modified != items.at(i).modified || fresh.bytes != items.at(i).bytes) {
+            fresh = TileInfo::fromHeader(fresh.url);
+            if(fresh.size.isEmpty()) fresh.size = items.at(i).size;
+            updates.append(Update { i, fresh, true });
+        }
+    }
+    return updates;
+}
+
+}    // namespace
+
+AlbumIndex::AlbumIndex(QString const& key, QObject* parent)
+    : QObject(parent)
+    , dirty_(false) {
+    if(key.isEmpty()) return;
+    QString dir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + QStringLiteral("/flowview/albums");
+    QDir().mkpath(dir);
+    auto hash = QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Sha1).toHex();
+    path_     = dir + QLatin1Char('/') + QString::fromLatin1(hash) + QStringLiteral(".index");
+    load();
+}
+
+AlbumIndex::~AlbumIndex() {
+    save();
+}
+
+QString AlbumIndex::keyOf(QList<int> albums) {
+    if(albums.isEmpty()) return QString();
+    std::sort(albums.begin(), albums.end());
+    QStringList ids;
+    for(int id: albums) ids << QString::number(id);
+    return ids.join(QLatin1Char(','));
+}
+
+bool AlbumIndex::find(QUrl const& url, TileInfo& info) const {
+    auto it = positions_.constFind(url.toLocalFile());
+    if(it == positions_.constEnd()) return false;
+    info = loaded_.at(it.value());
+    return true;
+}
+
+void AlbumIndex::append(TileInfo const& info) {
+    int position = items_.count();
+    if(position >= loaded_.count() || !sameTile(loaded_.at(position), info)) dirty_ = true;
+    items_.append(info);
+}
+
+void AlbumIndex::reconcile() {
+    if(path_.isEmpty()) return;
+    auto watcher = new QFutureWatcher<QVector<Update>>(this);
+    connect(watcher, &QFutureWatcher<QVector<Update>>::finished, this, [this, watcher]() {
+        watcher->deleteLater();
+        for(auto& update: watcher->result()) {
+            if(update.position >= items_.count() || items_.at(update.position).url != update.info.url) continue;
+            items_[update.position] = update.info;
+            dirty_                  = true;
+            if(update.changed) emit changed(update.position, update.info);
+        }
+    });
+    watcher->setFuture(QtConcurrent::run(checkFiles, items_));
+}
+
+// The entries are copied out of the mapped file, the map is gone after this
+void AlbumIndex::load() {
+    Profiler::Scope scope("index");
+    QFile           file(path_);
+    if(!file.open(QIODevice::ReadOnly) || file.size() < qint64(sizeof(Header))) return;
+    uchar const* data = file.map(0, file.size());
+    if(!data) return;
+
+    Header header;
+    std::memcpy(&header, data, sizeof(Header));
+    if(header.magic != kMagic || header.version != kVersion || header.count < 0) return;
+
+    uchar const* it  = data + sizeof(Header);
+    uchar const* end = data + file.size();
+    loaded_.reserve(header.count);
+    positions_.reserve(header.count);
+    for(int i = 0; i < header.count; ++i) {
+        Entry entry;
+        if(end - it < qint64(sizeof(Entry))) break;
+        std::memcpy(&entry, it, sizeof(Entry));
+        it += sizeof(Entry);
+        if(entry.pathLength < 0 || end - it < entry.pathLength) break;
+
+        TileInfo info;
+        QString  path    = QString::fromUtf8(reinterpret_cast<char const*>(it), entry.pathLength);
+        info.url         = QUrl::fromLocalFile(path);
+        info.size        = QSize(entry.width, entry.height);
+        info.orientation = entry.orientation;
+        info.modified    = entry.modified;
+        info.bytes       = entry.bytes;
+        it += entry.pathLength;
+
+        positions_.insert(path, loaded_.count());
+        loaded_.append(info);
+    }
+}
+
+void AlbumIndex::save() {
+    if(path_.isEmpty() || (!dirty_ && items_.count() == loaded_.count())) return;
+
+    QByteArray data;
+    Header     header { kMagic, kVersion, items_.count(), 0 };
+    data.append(reinterpret_cast<char const*>(&header), sizeof(Header));
+    for(auto& info: items_) {
+        QByteArray path = info.url.toLocalFile().toUtf8();
+        Entry      entry { info.modified, info.bytes, info.size.width(), info.size.height(), info.orientation,
+                      path.size() };
+        data.append(reinterpret_cast<char const*>(&entry), sizeof(Entry));
+        data.append(path);
+    }
+
+    QSaveFile file(path_);
+    if(!file.open(QIODevice::WriteOnly)) return;
+    file.write(data);
+    if(!file.commit()) qCDebug(DIGIKAM_DPLUGIN_GENERIC_LOG) << "Write album index failed: " << path_;
+}
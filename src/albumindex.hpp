@@ -0,0 +1,69 @@
+/* ============================================================
+ *
+ * This file is a part of digiKam flow plugin project
+ * https://github.com/cathaysia/digikamflowplugin
+ *
+ * Date        : 2021-05-22
+ * Description : Per album index of the tiles, kept between sessions.
+ *
+ * Copyright (C) 2021-2022 by DragonBillow <DragonBillow at outlook dot com>
+ *
+ * Redistribution and use is allowed according to the terms of the GPL3 license.
+ * For details see the accompanying LICENSE file.
+ *
+ * ============================================================ */
+
+#pragma once
+
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QString>
+#include <QVector>
+
+#include "tileinfo.hpp"
+
+/**
+ * AlbumIndex remembers the TileInfo of every picture of an album: size,
+ * orientation, and the mtime and size of the file ThumbCache keys on. Opening
+ * the album again places every known tile from the index, without asking
+ * digikam's database or reading an image header.
+ *
+ * The index is one file per album, mapped when it is opened. After the tiles
+ * are placed, reconcile() checks the files on a worker thread and reports the
+ * pictures changed since the index was written. The index is written again
+ * when it is destroyed, with the pictures of this session in album order.
+ */
+class AlbumIndex : public QObject {
+    Q_OBJECT;
+
+public:
+    // an empty key disables the index
+    explicit AlbumIndex(QString const& key, QObject* parent = nullptr);
+    ~AlbumIndex() override;
+
+    // key of the albums shown together
+    static QString keyOf(QList<int> albums);
+
+    // false when url is not in the index
+    bool find(QUrl const& url, TileInfo& info) const;
+    // the next picture of the album, its position is the order of the calls
+    void append(TileInfo const& info);
+    // check the files of the appended pictures in background
+    void reconcile();
+
+signals:
+    // the file of a picture changed after the index was written
+    void changed(int position, TileInfo const& info);
+
+private:
+    void load();
+    void save();
+
+    QString           path_;
+    QVector<TileInfo> loaded_;
+    // by local file
+    QHash<QString, int> positions_;
+    QVector<TileInfo>   items_;
+    bool                dirty_;
+};
@@ -17,77 +17,237 @@
 
 #include <QApplication>
 #include <QDebug>
-#include <QDialog>
-#include <QHBoxLayout>
+#include <QFutureWatcher>
+#include <QtConcurrent>
 
-// Only three decimal place
-inline qreal sizeFactor(QSize const &a) {
-    if(!a.height() || !a.width()) return 0;
-    return a.width() * 1000 / a.height() / 1000.f;
+#include "imageviewer.hpp"
+#include "profiler.hpp"
+#include "resampler.hpp"
+#include "tilebudget.hpp"
+#include "tileinfo.hpp"
+
+// Scaled pixmaps are reused while the size stays in the same 16 pixels step
+constexpr int kSizeStep = 16;
+
+inline quint64 sizeKey(QSize const &a) {
+    quint64 w = (a.width() + kSizeStep - 1) / kSizeStep;
+    quint64 h = (a.height() + kSizeStep - 1) / kSizeStep;
+    return (w << 32) | h;
+}
+
+// Cover the label and crop the rest in one pass, runs on worker threads too
+static QImage cropScaled(QImage const &src, QSize const &target) {
+    if(src.isNull() || target.isEmpty()) return QImage();
+    Profiler::Scope scope("scale");
+    return Resampler::cropped(src, target);
 }
 
 AspectRatioPixmapLabel::AspectRatioPixmapLabel(QWidget *parent) : QLabel(parent) {
     setScaledContents(true);
+    // placeholder color, covered after the picture is loaded
+    setBackgroundRole(QPalette::Mid);
+    setAutoFillBackground(true);
+}
+
+AspectRatioPixmapLabel::~AspectRatioPixmapLabel() {
+    TileBudget::instance()->remove(this);
 }
 
 void AspectRatioPixmapLabel::setPixmap(const QPixmap &p) {
-    pix_         = p.toImage();
-    scaleFactor_ = sizeFactor(size());
-    QLabel::setPixmap(scaledPixmap());
+    setImage(p.toImage());
+}
+
+void AspectRatioPixmapLabel::setImage(QImage const &img) {
+    pix_       = img;
+    level_     = TileInfo::levelFor(qMax(pix_.width(), pix_.height()));
+    requested_ = 0;
+    evicted_   = false;
+    preview_   = false;
+    dropScaled();
+    // the first pixmap of a picture is scaled right now, nothing is there to stretch
+    if(size().isEmpty()) return QLabel::setPixmap(QPixmap());
+    showScaled(sizeKey(size()), scaledPixmap());
+}
+
+// Only the pixels change, the size of the label comes from setSourceSize(), so nothing is laid out again
+void AspectRatioPixmapLabel::setPreview(QImage const &img) {
+    if(!pix_.isNull() || img.isNull()) return;
+    pix_     = img;
+    preview_ = true;
+    dropScaled();
+    if(size().isEmpty()) return;
+    showScaled(sizeKey(size()), scaledPixmap());
+}
+
+void AspectRatioPixmapLabel::setPlaceholder(QRgb color) {
+    if(!color) return setPalette(QPalette());
+    QPalette palette = this->palette();
+    palette.setColor(QPalette::Mid, QColor(color));
+    setPalette(palette);
+}
+
+void AspectRatioPixmapLabel::setIndex(int index) {
+    index_ = index;
+}
+
+int AspectRatioPixmapLabel::index() const {
+    return index_;
+}
+
+void AspectRatioPixmapLabel::setUrl(QUrl const &url) {
+    url_ = url;
+}
+
+int AspectRatioPixmapLabel::level() const {
+    return level_;
+}
+
+int AspectRatioPixmapLabel::neededLevel() const {
+    if(size().isEmpty()) return 0;
+    return TileInfo::levelFor(size_, size(), devicePixelRatioF());
+}
+
+// Ask for a bigger level when the label grows, drop to a smaller one when it shrinks
+void AspectRatioPixmapLabel::updateLevel() {
+    int needed = neededLevel();
+    if(!needed || needed == level_) return;
+    if(needed > level_) {
+        if(requested_ >= needed) return;
+        requested_ = needed;
+        emit levelRequested(index_, needed);
+        return;
+    }
+    pix_   = Resampler::fitted(pix_, QSize(needed, needed));
+    level_ = needed;
+    account();
+}
+
+// the source picture and the scaled pixmaps kept for QLabel
+void AspectRatioPixmapLabel::account() {
+    qint64 bytes = qint64(pix_.bytesPerLine()) * pix_.height();
+    for(auto &it: scaled_) bytes += qint64(it.width()) * it.height() * 4;
+    TileBudget::instance()->insert(this, bytes);
+}
+
+void AspectRatioPixmapLabel::showScaled(quint64 key, QPixmap const &pix) {
+    // keep the shown one and the previous one, resizing back and forth hits them
+    if(scaled_.count() >= 2 && !scaled_.contains(key)) {
+        for(auto it = scaled_.begin(); it != scaled_.end();) {
+            if(it.key() == shownKey_) ++it;
+            else
+                it = scaled_.erase(it);
+        }
+    }
+    scaled_.insert(key, pix);
+    shownKey_ = key;
+    QLabel::setPixmap(pix);
+    account();
+}
+
+void AspectRatioPixmapLabel::dropScaled() {
+    scaled_.clear();
+    shownKey_   = 0;
+    pendingKey_ = 0;
+    ++generation_;
+}
+
+// QLabel stretches the old pixmap until the worker delivers the new one
+void AspectRatioPixmapLabel::rescale(quint64 key) {
+    pendingKey_  = key;
+    int  gen     = ++generation_;
+    auto watcher = new QFutureWatcher<QImage>(this);
+    connect(watcher, &QFutureWatcher<QImage>::finished, this, [this, watcher, gen, key]() {
+        watcher->deleteLater();
+        if(gen != generation_) return;
+        pendingKey_ = 0;
+        showScaled(key, QPixmap::fromImage(watcher->result()));
+    });
+    watcher->setFuture(QtConcurrent::run(cropScaled, pix_, size()));
+}
+
+void AspectRatioPixmapLabel::evict() {
+    if(pix_.isNull()) return;
+    pix_       = QImage();
+    level_     = 0;
+    requested_ = 0;
+    evicted_   = true;
+    preview_   = false;
+    dropScaled();
+    QLabel::clear();
+    TileBudget::instance()->remove(this);
+}
+
+void AspectRatioPixmapLabel::touch() {
+    if(!evicted_) return TileBudget::instance()->touch(this);
+    evicted_ = false;
+    emit levelRequested(index_, neededLevel());
+}
+
+void AspectRatioPixmapLabel::setSourceSize(QSize const &size) {
+    size_ = size;
+    updateGeometry();
 }
 
 QSize AspectRatioPixmapLabel::sizeHint() const {
+    if(size_.isValid()) return size_;
     return pix_.size();
 }
 
 QPixmap AspectRatioPixmapLabel::scaledPixmap() const {
-    /**
-     * first scaled image using KeepAspectRatioByExpanding,
-     * at this time, image is bigger than QSize()
-     * then clip image to this->size()
-     */
-    if(heightForWidth(width()) < height()) {
-        // width 相对变小
-        auto tmp = pix_.scaled(widthForHeight(height()), height(), Qt::KeepAspectRatioByExpanding,
-                               Qt::TransformationMode::FastTransformation);
-        auto res = tmp.copy(0, 0, width(), height());
-        return QPixmap::fromImage(res);
-    }
-
-    auto tmp = pix_.scaled(width(), heightForWidth(width()), Qt::KeepAspectRatioByExpanding,
-                           Qt::TransformationMode::FastTransformation);
-    auto res = tmp.copy(0, 0, width(), height());
-    return QPixmap::fromImage(res);
+    return QPixmap::fromImage(cropScaled(pix_, size()));
 }
 
 void AspectRatioPixmapLabel::adjust() {
     if(pix_.isNull()) return;
-    qreal scaleFactor = sizeFactor(size());
-    if(!scaleFactor || (scaleFactor == scaleFactor_)) return;
-    scaleFactor_ = scaleFactor;
+    // the final picture is on its way
+    if(!preview_) updateLevel();
+    if(size().isEmpty()) return;
+
+    quint64 key = sizeKey(size());
+    if(key == shownKey_ || key == pendingKey_) return;
+    auto it = scaled_.constFind(key);
+    if(it == scaled_.constEnd()) return rescale(key);
+    // a cached size, cancel the pending one
+    ++generation_;
+    pendingKey_ = 0;
+    showScaled(key, it.value());
+}
 
-    QLabel::setPixmap(scaledPixmap());
+void AspectRatioPixmapLabel::reset() {
+    pix_       = QImage();
+    size_      = QSize();
+    url_       = QUrl();
+    index_     = -1;
+    level_     = 0;
+    requested_ = 0;
+    evicted_   = false;
+    preview_   = false;
+    dropScaled();
+    setPalette(QPalette());
+    QLabel::clear();
+    TileBudget::instance()->remove(this);
 }
+
 int AspectRatioPixmapLabel::heightForWidth(int w) const {
     // height = width*(y/x)
     // ry/rx=y/x ==> ry=rx*y/x
     // height = width * sizeHint().rheight() / sizeHint().rwidth();
+    if(!sizeHint().rwidth()) return 0;
     return w * sizeHint().rheight() / sizeHint().rwidth();
 }
 
 int AspectRatioPixmapLabel::widthForHeight(int h) const {
     // rw/rh = w/h ==> w = rw/rh * h
+    if(!sizeHint().rheight()) return 0;
     return h * sizeHint().width() / sizeHint().rheight();
 }
 void AspectRatioPixmapLabel::mouseDoubleClickEvent(QMouseEvent *event) {
-    auto dialog = new QDialog;
-    dialog->setAttribute(Qt::WidgetAttribute::WA_DeleteOnClose, true);
-    dialog->setLayout(new QHBoxLayout);
-
-    auto lbl = new QLabel(dialog);
-    lbl->setPixmap(QPixmap::fromImage(this->pix_));
-    lbl->setScaledContents(false);
-    dialog->layout()->addWidget(lbl);
+    Q_UNUSED(event);
+    openViewer(pix_, url_);
+}
 
-    dialog->showFullScreen();
+void AspectRatioPixmapLabel::openViewer(QImage const &preview, QUrl const &url) {
+    auto viewer = new ImageViewer(preview, url);
+    viewer->setAttribute(Qt::WidgetAttribute::WA_DeleteOnClose, true);
+    viewer->showFullScreen();
 }
@@ -15,26 +15,74 @@
 
 #pragma once
 
+#include <QHash>
 #include <QImage>
 #include <QLabel>
 #include <QPixmap>
 #include <QResizeEvent>
+#include <QUrl>
 
 class AspectRatioPixmapLabel : public QLabel {
     Q_OBJECT;
 
 public:
     explicit AspectRatioPixmapLabel(QWidget *parent = 0);
+    ~AspectRatioPixmapLabel() override;
     QSize   sizeHint() const override;
     QPixmap scaledPixmap() const;
     void    setPixmap(const QPixmap &pix);
+    // the label shares img, no pixels are copied
+    void    setImage(QImage const &img);
+    // a low resolution picture shown until setImage(), ignored when a picture is there
+    void    setPreview(QImage const &img);
+    // color shown before any picture, 0 is the palette color
+    void    setPlaceholder(QRgb color);
+    // size of the picture before it is loaded, so a placeholder has the right shape
+    void    setSourceSize(QSize const &size);
+    void    setIndex(int index);
+    int     index() const;
+    // the viewer loads the full resolution picture from url
+    void    setUrl(QUrl const &url);
+    // edge of the decoded level, 0 without a picture
+    int     level() const;
+    int     neededLevel() const;
     int     heightForWidth(int w) const override;
     int     widthForHeight(int h) const;
     void    mouseDoubleClickEvent(QMouseEvent *event) override;
+    // full screen ImageViewer, shows preview until the tiles of url are decoded
+    static void openViewer(QImage const &preview, QUrl const &url);
 
     void adjust();
+    // drop the picture, so this label can be reused for another tile
+    void reset();
+    // drop the picture for the memory budget, it is requested again by touch()
+    void evict();
+    // the label is visible now, reload an evicted picture
+    void touch();
+
+signals:
+    // the label grew bigger than its level, edge is the level it needs
+    void levelRequested(int index, int edge);
 
 private:
-    qreal  scaleFactor_ = 0;
+    void updateLevel();
+    void account();
+    void showScaled(quint64 key, QPixmap const &pix);
+    void dropScaled();
+    void rescale(quint64 key);
+
     QImage pix_;
+    // scaled pixmaps by size step, see sizeKey()
+    QHash<quint64, QPixmap> scaled_;
+    quint64                 shownKey_   = 0;
+    quint64                 pendingKey_ = 0;
+    int                     generation_ = 0;
+    QSize  size_;
+    QUrl   url_;
+    int    index_     = -1;
+    int    level_     = 0;
+    int    requested_ = 0;
+    bool   evicted_   = false;
+    // pix_ is a preview, it does not count as a level
+    bool   preview_   = false;
 };
@@ -0,0 +1,122 @@
+/* ============================================================
+ *
+ * This file is a part of digiKam flow plugin project
+ * https://github.com/cathaysia/digikamflowplugin
+ *
+ * Date        : 2021-05-22
+ * Description : Decoded pictures shared by all flow views.
+ *
+ * Copyright (C) 2021-2022 by DragonBillow <DragonBillow at outlook dot com>
+ *
+ * Redistribution and use is allowed according to the terms of the GPL3 license.
+ * For details see the accompanying LICENSE file.
+ *
+ * ============================================================ */
+
+#include "decodecache.hpp"
+
+#include <QMutexLocker>
+
+#include <algorithm>
+
+// both stamps are known and one of them differs
+inline bool changed(qint64 a, qint64 b) {
+    return a >= 0 && b >= 0 && a != b;
+}
+
+DecodeCache::DecodeCache(int mb) : capacity_(qint64(std::max(mb, 0)) * 1024 * 1024) { }
+
+void DecodeCache::setCapacity(int mb) {
+    QMutexLocker locker(&mutex_);
+    capacity_ = qint64(std::max(mb, 0)) * 1024 * 1024;
+    evict();
+}
+
+int DecodeCache::capacity() const {
+    QMutexLocker locker(&mutex_);
+    return int(capacity_ / 1024 / 1024);
+}
+
+QFuture<QImage> DecodeCache::request(TileInfo const& info, int edge, bool* claimed) {
+    QMutexLocker locker(&mutex_);
+    auto&        edges = entries_[info.url.toLocalFile()];
+    auto         it    = edges.find(edge);
+    // a picture decoded before the file changed is dropped, a running decode is joined anyway
+    if(it != edges.end() && it->size && (changed(it->modified, info.modified) || changed(it->bytes, info.bytes))) {
+        used_ -= it->size;
+        order_.erase(it->order);
+        edges.erase(it);
+        it = edges.end();
+    }
+
+    if(it != edges.end()) {
+        if(it->size) {
+            order_.splice(order_.end(), order_, it->order);
+            ++stats_.hits;
+        } else {
+            ++stats_.joins;
+        }
+        *claimed = false;
+        return it->promise.future();
+    }
+
+    Entry entry { QFutureInterface<QImage>(), info.modified, info.bytes, 0, order_.end() };
+    entry.promise.reportStarted();
+    edges.insert(edge, entry);
+    ++stats_.decodes;
+    *claimed = true;
+    return entry.promise.future();
+}
+
+void DecodeCache::finish(TileInfo const& info, int edge, QImage const& img) {
+    QMutexLocker locker(&mutex_);
+    auto         path = entries_.find(info.url.toLocalFile());
+    if(path == entries_.end()) return;
+    auto it = path->find(edge);
+    // finished already, or forgotten while it was decoded
+    if(it == path->end() || it->size) return;
+
+    QFutureInterface<QImage> promise = it->promise;
+    if(img.isNull()) {
+        path->erase(it);
+        if(path->isEmpty()) entries_.erase(path);
+    } else {
+        it->size  = qMax<qint64>(qint64(img.bytesPerLine()) * img.height(), 1);
+        it->order = order_.insert(order_.end(), Key(path.key(), edge));
+        used_ += it->size;
+    }
+    promise.reportResult(img);
+    promise.reportFinished();
+    evict();
+}
+
+void DecodeCache::forget(QUrl const& url) {
+    QMutexLocker locker(&mutex_);
+    auto         edges = entries_.take(url.toLocalFile());
+    for(auto& entry: edges) {
+        used_ -= entry.size;
+        if(entry.size) {
+            order_.erase(entry.order);
+            continue;
+        }
+        // the waiters load the new file themselves
+        entry.promise.reportResult(QImage());
+        entry.promise.reportFinished();
+    }
+}
+
+DecodeCache::Stats DecodeCache::stats() const {
+    QMutexLocker locker(&mutex_);
+    return stats_;
+}
+
+// Only decoded pictures are dropped, the running decodes have waiters
+void DecodeCache::evict() {
+    while(used_ > capacity_ && !order_.empty()) {
+        Key oldest = order_.front();
+        order_.pop_front();
+        auto path = entries_.find(oldest.first);
+        used_ -= path->take(oldest.second).size;
+        if(path->isEmpty()) entries_.erase(path);
+    }
+}
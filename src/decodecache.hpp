@@ -0,0 +1,98 @@
+/* ============================================================
+ *
+ * This file is a part of digiKam flow plugin project
+ * https://github.com/cathaysia/digikamflowplugin
+ *
+ * Date        : 2021-05-22
+ * Description : Decoded pictures shared by all flow views.
+ *
+ * Copyright (C) 2021-2022 by DragonBillow <DragonBillow at outlook dot com>
+ *
+ * Redistribution and use is allowed according to the terms of the GPL3 license.
+ * For details see the accompanying LICENSE file.
+ *
+ * ============================================================ */
+
+#pragma once
+
+#include <QFuture>
+#include <QFutureInterface>
+#include <QHash>
+#include <QImage>
+#include <QMutex>
+#include <QPair>
+#include <QString>
+
+#include <list>
+
+#include "tileinfo.hpp"
+
+/**
+ * DecodeCache keeps the pictures decoded for the tiles by path and decode
+ * edge, for all flow views: the plugin owns it and every PicDialog shares it.
+ * Opening an album again, or two albums with the same pictures, does not
+ * decode them again.
+ *
+ * A picture being decoded is in the cache too. The first request claims the
+ * decode, the next ones get the future of that decode instead of decoding the
+ * file again. A claim must be finished, with a null picture when the decode
+ * failed or was dropped; the waiters then load the picture themselves.
+ *
+ * The pictures are implicitly shared, the cache and every tile showing one
+ * hold the same pixels. Over its capacity the cache drops the pictures
+ * requested least recently, the tiles keep theirs.
+ *
+ * All functions are thread safe.
+ */
+class DecodeCache {
+public:
+    struct Stats {
+        // found decoded
+        int hits    = 0;
+        // waited for the decode of another request
+        int joins   = 0;
+        // claimed, the caller decoded it
+        int decodes = 0;
+    };
+
+    // capacity in MB
+    explicit DecodeCache(int mb = 256);
+
+    void setCapacity(int mb);
+    int  capacity() const;
+
+    // claimed is set when the caller has to decode the picture and finish() it,
+    // otherwise the future is finished or finishes with the decode of another caller
+    QFuture<QImage> request(TileInfo const& info, int edge, bool* claimed);
+    void            finish(TileInfo const& info, int edge, QImage const& img);
+    // the file changed, its pictures are decoded again
+    void forget(QUrl const& url);
+
+    Stats stats() const;
+
+private:
+    // path and edge
+    using Key = QPair<QString, int>;
+
+    struct Entry {
+        QFutureInterface<QImage> promise;
+        // file stamps of the request which claimed it, -1 when not known
+        qint64                   modified;
+        qint64                   bytes;
+        // bytes of the picture, 0 while it is decoded
+        qint64                   size;
+        // place in order_, only decoded pictures have one
+        std::list<Key>::iterator order;
+    };
+
+    void evict();
+
+    mutable QMutex                    mutex_;
+    // by path, then by edge
+    QHash<QString, QHash<int, Entry>> entries_;
+    // decoded pictures, least recently requested first
+    std::list<Key>                    order_;
+    qint64                            capacity_;
+    qint64                            used_ = 0;
+    Stats                             stats_;
+};
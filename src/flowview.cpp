@@ -0,0 +1,362 @@
+/* ============================================================
+ *
+ * This file is a part of digiKam flow plugin project
+ * https://github.com/cathaysia/digikamflowplugin
+ *
+ * Date        : 2021-05-22
+ * Description : Virtualized flow view, only visible tiles own a widget.
+ *
+ * Copyright (C) 2021-2022 by DragonBillow <DragonBillow at outlook dot com>
+ *
+ * Redistribution and use is allowed according to the terms of the GPL3 license.
+ * For details see the accompanying LICENSE file.
+ *
+ * ============================================================ */
+
+#include "flowview.hpp"
+
+#include <QEvent>
+#include <QMouseEvent>
+#include <QPaintEvent>
+#include <QPainter>
+#include <QScrollArea>
+#include <QScrollBar>
+#include <QTimer>
+#include <QtConcurrent>
+
+#include "aspectratiopixmaplabel.hpp"
+#include "profiler.hpp"
+#include "tileinfo.hpp"
+
+// milliseconds of a frame
+constexpr int kFrameInterval = 16;
+// smaller albums are laid out in a fraction of a frame, on the GUI thread
+constexpr int kAsyncTiles = 4096;
+
+FlowView::FlowView(QScrollArea* area, QWidget* parent)
+    : QWidget(parent)
+    , area_(area)
+    , painted_(false)
+    , repaintPending_(false)
+    , layoutWatcher_(new QFutureWatcher<TileLayout>(this))
+    , layoutRunning_(false)
+    , layoutAgain_(false)
+    , overscan_(600)
+    , lookahead_(0)
+    , layoutPasses_(0)
+    , relayoutPending_(false) {
+    connect(layoutWatcher_, &QFutureWatcher<TileLayout>::finished, this, &FlowView::layoutReady);
+    area_->viewport()->installEventFilter(this);
+    connect(area_->verticalScrollBar(), &QScrollBar::valueChanged, this, &FlowView::updateVisible);
+}
+
+void FlowView::setPainted(bool painted) {
+    painted_ = painted;
+    // every pixel of a painted view is drawn by paintEvent
+    setAttribute(Qt::WA_OpaquePaintEvent, painted);
+}
+
+bool FlowView::painted() const {
+    return painted_;
+}
+
+void FlowView::setFrameBudget(int ms) {
+    painter_.setBudget(ms);
+}
+
+void FlowView::setReferenceWidth(qreal width) {
+    layout_.setReferenceWidth(width);
+    scheduleRelayout();
+}
+
+qreal FlowView::referenceWidth() const {
+    return layout_.referenceWidth();
+}
+
+void FlowView::setSpacing(int spacing) {
+    layout_.setSpacing(spacing);
+    scheduleRelayout();
+}
+
+int FlowView::spacing() const {
+    return layout_.spacing();
+}
+
+void FlowView::setStyle(Z::Style sty) {
+    layout_.setStyle(TileLayout::styleFromName(sty));
+    scheduleRelayout();
+}
+
+void FlowView::setOverscan(int overscan) {
+    overscan_ = qMax(overscan, 0);
+    updateVisible();
+}
+
+int FlowView::overscan() const {
+    return overscan_;
+}
+
+void FlowView::setLookahead(int pixels) {
+    if(lookahead_ == pixels) return;
+    lookahead_ = pixels;
+    updateVisible();
+}
+
+int FlowView::append(QUrl const& url, QSize const& size, QRgb color) {
+    urls_.append(url);
+    colors_.append(color);
+    int index = layout_.count();
+    setSize(index, size);
+    scheduleRelayout();
+    return index;
+}
+
+int FlowView::count() const {
+    return urls_.count();
+}
+
+QUrl FlowView::url(int index) const {
+    return urls_.value(index);
+}
+
+QRect FlowView::tileRect(int index) const {
+    return layout_.rect(index);
+}
+
+void FlowView::setTileImage(int index, QImage const& img) {
+    if(painted_) {
+        if(!requested_.contains(index) || img.isNull()) return;
+        if(layout_.size(index).isEmpty()) {
+            setSize(index, img.size());
+            scheduleRelayout();
+        }
+        requested_[index] = 0;
+        painter_.setImage(index, img, false);
+        return update(layout_.rect(index));
+    }
+    auto lbl = active_.value(index);
+    if(!lbl || img.isNull()) return;
+    if(layout_.size(index).isEmpty()) {
+        setSize(index, img.size());
+        scheduleRelayout();
+    }
+    lbl->setImage(img);
+}
+
+void FlowView::setTileSize(int index, QSize const& size) {
+    if(index < 0 || index >= count()) return;
+    setSize(index, size);
+    scheduleRelayout();
+    if(painted_) {
+        painter_.remove(index);
+        if(requested_.contains(index)) emit tileRequested(index, urls_.at(index));
+        return;
+    }
+    auto lbl = active_.value(index);
+    if(!lbl) return;
+    lbl->setSourceSize(size);
+    emit tileRequested(index, urls_.at(index));
+}
+
+void FlowView::setTilePreview(int index, QImage const& img) {
+    if(painted_) {
+        if(!requested_.contains(index)) return;
+        painter_.setImage(index, img, true);
+        return update(layout_.rect(index));
+    }
+    if(auto lbl = active_.value(index)) lbl->setPreview(img);
+}
+
+int FlowView::layoutPasses() const {
+    return layoutPasses_;
+}
+
+// The viewport of scroll area decides our width
+bool FlowView::eventFilter(QObject* watched, QEvent* event) {
+    if(watched == area_->viewport() && event->type() == QEvent::Resize) scheduleRelayout();
+    return false;
+}
+
+// Appends, resizes and setting changes within one frame share a single relayout,
+// which only recomputes the tiles TileLayout can not keep
+void FlowView::scheduleRelayout() {
+    if(relayoutPending_) return;
+    relayoutPending_ = true;
+    QTimer::singleShot(0, this, &FlowView::relayout);
+}
+
+void FlowView::relayout() {
+    relayoutPending_ = false;
+    layout_.setWidth(area_->viewport()->width());
+    if(layout_.count() < kAsyncTiles) {
+        Profiler::Scope scope("relayout");
+        ++layoutPasses_;
+        layout_.update();
+        return applyLayout();
+    }
+
+    // one layout at a time, the changes meanwhile are coalesced into the next one
+    if(layoutRunning_) {
+        layoutAgain_ = true;
+        return;
+    }
+    if(!layout_.isDirty()) return applyLayout();
+    ++layoutPasses_;
+    layoutRunning_ = true;
+    sizeLog_.clear();
+    layoutWatcher_->setFuture(QtConcurrent::run([snapshot = layout_]() mutable {
+        Profiler::Scope scope("relayout");
+        snapshot.update();
+        return snapshot;
+    }));
+}
+
+// A result computed for other settings or another width is dropped, the old geometry stays
+// on screen until the next one is ready. Sizes which changed meanwhile are replayed on it.
+void FlowView::layoutReady() {
+    layoutRunning_  = false;
+    TileLayout next = layoutWatcher_->result();
+    if(next.sameSettings(layout_)) {
+        for(auto& it: sizeLog_) {
+            if(it.first < next.count()) next.setSize(it.first, it.second);
+            else
+                next.append(it.second);
+        }
+        layout_ = next;
+        applyLayout();
+    }
+    sizeLog_.clear();
+    if(layoutAgain_ || layout_.isDirty()) {
+        layoutAgain_ = false;
+        scheduleRelayout();
+    }
+}
+
+void FlowView::applyLayout() {
+    resize(layout_.width(), layout_.height());
+    for(auto it = active_.begin(); it != active_.end(); ++it) {
+        it.value()->setGeometry(layout_.rect(it.key()));
+        it.value()->adjust();
+    }
+    updateVisible();
+    if(!painted_) return;
+    requestLevels();
+    update();
+}
+
+void FlowView::setSize(int index, QSize const& size) {
+    if(index < layout_.count()) layout_.setSize(index, size);
+    else
+        layout_.append(size);
+    if(layoutRunning_) sizeLog_.append(qMakePair(index, size));
+}
+
+void FlowView::updateVisible() {
+    QRect        region  = band();
+    QVector<int> visible = layout_.indicesIn(region);
+
+    if(painted_) {
+        for(auto index: requested_.keys()) {
+            if(layout_.rect(index).intersects(region)) continue;
+            requested_.remove(index);
+            painter_.remove(index);
+            emit tileReleased(index);
+        }
+        for(int index: visible) {
+            if(requested_.contains(index)) continue;
+            requested_.insert(index, TileInfo::levelFor(layout_.size(index), layout_.rect(index).size(),
+                                                        devicePixelRatioF()));
+            emit tileRequested(index, urls_.at(index));
+        }
+        return;
+    }
+
+    // recycle tiles that scrolled away
+    for(auto index: active_.keys())
+        if(!layout_.rect(index).intersects(region)) release(index);
+
+    for(int index: visible) {
+        if(active_.contains(index)) {
+            active_.value(index)->touch();
+            continue;
+        }
+        auto lbl = acquire();
+        lbl->setIndex(index);
+        lbl->setUrl(urls_.at(index));
+        lbl->setSourceSize(layout_.size(index));
+        lbl->setPlaceholder(colors_.at(index));
+        lbl->setGeometry(layout_.rect(index));
+        lbl->show();
+        active_.insert(index, lbl);
+        emit tileRequested(index, urls_.at(index));
+    }
+}
+
+AspectRatioPixmapLabel* FlowView::acquire() {
+    if(!recycled_.isEmpty()) return recycled_.takeLast();
+    auto lbl = new AspectRatioPixmapLabel(this);
+    // the tile grew over its level, load a bigger one
+    connect(lbl, &AspectRatioPixmapLabel::levelRequested, this, [this](int index) {
+        if(active_.contains(index)) emit this->tileRequested(index, urls_.at(index));
+    });
+    return lbl;
+}
+
+void FlowView::release(int index) {
+    auto lbl = active_.take(index);
+    if(!lbl) return;
+    lbl->hide();
+    lbl->reset();
+    recycled_.append(lbl);
+    emit tileReleased(index);
+}
+
+void FlowView::requestLevels() {
+    for(auto it = requested_.begin(); it != requested_.end(); ++it) {
+        int level = painter_.level(it.key());
+        // still loading, the load in flight is not asked again
+        if(!level || it.value()) continue;
+        int needed = TileInfo::levelFor(layout_.size(it.key()), layout_.rect(it.key()).size(), devicePixelRatioF());
+        if(needed <= level) continue;
+        it.value() = needed;
+        emit tileRequested(it.key(), urls_.at(it.key()));
+    }
+}
+
+// Only the exposed part is painted, scrolling exposes a strip of a few tiles
+void FlowView::paintEvent(QPaintEvent* event) {
+    if(!painted_) return QWidget::paintEvent(event);
+    Profiler::Scope scope("paint");
+
+    QPainter painter(this);
+    painter.fillRect(event->rect(), palette().color(QPalette::Window));
+
+    QRgb                       placeholder = palette().color(QPalette::Mid).rgb();
+    QVector<TilePainter::Tile> tiles;
+    for(int index: layout_.indicesIn(event->rect())) {
+        QRgb color = colors_.at(index);
+        tiles.append(TilePainter::Tile { index, layout_.rect(index), color ? color : placeholder });
+    }
+    if(painter_.paint(painter, tiles, devicePixelRatioF()) || repaintPending_) return;
+
+    // the budget ran out, scale the rest in the next frame
+    repaintPending_ = true;
+    QTimer::singleShot(kFrameInterval, this, [this]() {
+        repaintPending_ = false;
+        update();
+    });
+}
+
+void FlowView::mouseDoubleClickEvent(QMouseEvent* event) {
+    if(!painted_) return QWidget::mouseDoubleClickEvent(event);
+    auto indices = layout_.indicesIn(QRect(event->pos(), QSize(1, 1)));
+    if(indices.isEmpty()) return;
+    AspectRatioPixmapLabel::openViewer(painter_.image(indices.first()), urls_.at(indices.first()));
+}
+
+QRect FlowView::band() const {
+    int top   = area_->verticalScrollBar()->value();
+    int above = overscan_ + qMax(-lookahead_, 0);
+    int below = overscan_ + qMax(lookahead_, 0);
+    return QRect(0, top - above, width(), area_->viewport()->height() + above + below);
+}
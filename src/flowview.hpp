@@ -0,0 +1,119 @@
+/* ============================================================
+ *
+ * This file is a part of digiKam flow plugin project
+ * https://github.com/cathaysia/digikamflowplugin
+ *
+ * Date        : 2021-05-22
+ * Description : Virtualized flow view, only visible tiles own a widget.
+ *
+ * Copyright (C) 2021-2022 by DragonBillow <DragonBillow at outlook dot com>
+ *
+ * Redistribution and use is allowed according to the terms of the GPL3 license.
+ * For details see the accompanying LICENSE file.
+ *
+ * ============================================================ */
+
+#pragma once
+
+#include <QFutureWatcher>
+#include <QHash>
+#include <QImage>
+#include <QPair>
+#include <QUrl>
+#include <QVector>
+#include <QWidget>
+
+#include "flowlayout.h"
+#include "tilelayout.hpp"
+#include "tilepainter.hpp"
+
+class QScrollArea;
+class AspectRatioPixmapLabel;
+
+class FlowView : public QWidget {
+    Q_OBJECT;
+
+public:
+    explicit FlowView(QScrollArea* area, QWidget* parent = nullptr);
+
+    // paint every tile in one paintEvent instead of a label per tile, set it before any tile is appended
+    void setPainted(bool painted);
+    bool painted() const;
+    // milliseconds a painted frame may spend on scaling pictures
+    void setFrameBudget(int ms);
+
+    void  setReferenceWidth(qreal width);
+    qreal referenceWidth() const;
+    void  setSpacing(int spacing);
+    int   spacing() const;
+    void  setStyle(Z::Style);
+    // extra pixels above and below the viewport which still get widgets
+    void setOverscan(int overscan);
+    int  overscan() const;
+    // extra pixels of the band in the scroll direction, negative is up
+    void setLookahead(int pixels);
+
+    // color is the placeholder of the tile, 0 is the palette color
+    int   append(QUrl const& url, QSize const& size, QRgb color = 0);
+    int   count() const;
+    QUrl  url(int index) const;
+    QRect tileRect(int index) const;
+    // tiles out of the overscan band ignore the picture,
+    // a tile without known size takes the size of the picture
+    void setTileImage(int index, QImage const& img);
+    // the picture of the tile changed, its pixels are requested again
+    void setTileSize(int index, QSize const& size);
+    // low resolution picture shown until setTileImage()
+    void setTilePreview(int index, QImage const& img);
+    int  layoutPasses() const;
+
+    bool eventFilter(QObject* watched, QEvent* event) override;
+
+protected:
+    void paintEvent(QPaintEvent* event) override;
+    void mouseDoubleClickEvent(QMouseEvent* event) override;
+
+public slots:
+    void relayout();
+    void updateVisible();
+
+signals:
+    // tile entered the overscan band and has no picture yet
+    void tileRequested(int index, QUrl const& url);
+    // tile left the overscan band, its pending load is useless
+    void tileReleased(int index);
+
+private:
+    AspectRatioPixmapLabel* acquire();
+    void                    release(int index);
+    QRect                   band() const;
+    void                    scheduleRelayout();
+    // place the widgets after layout_ changed
+    void                    applyLayout();
+    void                    layoutReady();
+    // sizes changed while a layout is computed are replayed on its result
+    void                    setSize(int index, QSize const& size);
+    // painted tiles ask for a bigger level when they grew
+    void                    requestLevels();
+
+    QScrollArea*                        area_;
+    TileLayout                          layout_;
+    QVector<QUrl>                       urls_;
+    QVector<QRgb>                       colors_;
+    QHash<int, AspectRatioPixmapLabel*> active_;
+    QVector<AspectRatioPixmapLabel*>    recycled_;
+    bool                                painted_;
+    TilePainter                         painter_;
+    // painted tiles in the overscan band, by the level they asked for
+    QHash<int, int>                     requested_;
+    bool                                repaintPending_;
+    // big albums are laid out on a worker, from a copy of layout_
+    QFutureWatcher<TileLayout>*         layoutWatcher_;
+    bool                                layoutRunning_;
+    bool                                layoutAgain_;
+    QVector<QPair<int, QSize>>          sizeLog_;
+    int                                 overscan_;
+    int                                 lookahead_;
+    int                                 layoutPasses_;
+    bool                                relayoutPending_;
+};
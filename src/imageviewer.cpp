@@ -0,0 +1,354 @@
+/* ============================================================
+ *
+ * This file is a part of digiKam flow plugin project
+ * https://github.com/cathaysia/digikamflowplugin
+ *
+ * Date        : 2021-05-22
+ * Description : Full screen viewer decoding the visible region of a picture.
+ *
+ * Copyright (C) 2021-2022 by DragonBillow <DragonBillow at outlook dot com>
+ *
+ * Redistribution and use is allowed according to the terms of the GPL3 license.
+ * For details see the accompanying LICENSE file.
+ *
+ * ============================================================ */
+
+#include "imageviewer.hpp"
+
+#include <QFutureWatcher>
+#include <QImageIOHandler>
+#include <QImageReader>
+#include <QKeyEvent>
+#include <QMouseEvent>
+#include <QPainter>
+#include <QWheelEvent>
+#include <QtConcurrent>
+#include <QtMath>
+
+#include <algorithm>
+#include <cmath>
+
+#include "previewloadthread.h"
+#include "profiler.hpp"
+#include "resampler.hpp"
+#include "tilebudget.hpp"
+
+// edge of a tile in pixels of its level
+constexpr int kTileEdge = 512;
+// the user can zoom up to 8 screen pixels by picture pixel
+constexpr qreal kMaxZoom = 8;
+
+inline quint64 tileKey(int level, int x, int y) {
+    return (quint64(level) << 48) | (quint64(y) << 24) | quint64(x);
+}
+
+inline QSize levelSize(QSize const& size, int level) {
+    int round = (1 << level) - 1;
+    return QSize((size.width() + round) >> level, (size.height() + round) >> level);
+}
+
+ImageViewer::ImageViewer(QImage const& preview, QUrl const& url, QWidget* parent)
+    : QWidget(parent)
+    , url_(url)
+    , preview_(QPixmap::fromImage(preview)) {
+    setFocusPolicy(Qt::StrongFocus);
+    setCenter(QPointF(pictureSize().width(), pictureSize().height()) / 2);
+    if(url.isEmpty()) return;
+
+    // the header is read on a worker too, a network drive may take a while
+    auto watcher = new QFutureWatcher<Source>(this);
+    connect(watcher, &QFutureWatcher<Source>::finished, this, [this, watcher]() {
+        opened(watcher->result());
+        watcher->deleteLater();
+    });
+    watcher->setFuture(QtConcurrent::run(&ImageViewer::load, url.toLocalFile()));
+}
+
+ImageViewer::~ImageViewer() {
+    pool_.clear();
+    pool_.waitForDone();
+}
+
+ImageViewer::Source ImageViewer::load(QString const& path) {
+    Profiler::Scope scope("viewer open");
+    Source source;
+    source.path = path;
+    source.info = TileInfo::fromHeader(QUrl::fromLocalFile(path));
+
+    QImageReader reader(path);
+    if(!source.info.size.isEmpty() && reader.supportsOption(QImageIOHandler::ClipRect)
+       && reader.supportsOption(QImageIOHandler::ScaledSize))
+        return source;
+
+    // digikam decodes the formats Qt does not know, oriented already
+    reader.setAutoTransform(true);
+    source.full = reader.read();
+    if(source.full.isNull()) source.full = Digikam::PreviewLoadThread::loadHighQualitySynchronously(path).copyQImage();
+    // converted once here, not by every tile cut from it
+    source.full             = Resampler::converted(source.full);
+    source.info.size        = source.full.size();
+    source.info.orientation = 1;
+    return source;
+}
+
+// region is in oriented picture pixels, the reader wants them as stored in the file
+QImage ImageViewer::decode(Source const& source, QRect const& region, QSize const& target) {
+    Profiler::Scope scope("viewer tile");
+    if(!source.full.isNull()) return Resampler::scaled(source.full, region, target);
+
+    int   orientation = source.info.orientation;
+    bool  transposed  = orientation >= 5;
+    QSize stored      = transposed ? source.info.size.transposed() : source.info.size;
+    QRect clip = TileInfo::orientationMatrix(orientation, stored).inverted().mapRect(region) & QRect(QPoint(), stored);
+
+    QImageReader reader(source.path);
+    reader.setAutoTransform(false);
+    reader.setClipRect(clip);
+    reader.setScaledSize(transposed ? target.transposed() : target);
+    return TileInfo::oriented(reader.read(), orientation);
+}
+
+void ImageViewer::opened(Source const& source) {
+    if(source.info.size.isEmpty()) return;
+    // the preview may be cropped or rounded, keep the same part of the picture on the screen
+    QSizeF old   = pictureSize();
+    source_      = source;
+    opened_      = true;
+    QSizeF ratio = QSizeF(pictureSize().width() / old.width(), pictureSize().height() / old.height());
+    zoom_ /= qMax(ratio.width(), ratio.height());
+    if(fitted_) zoom_ = fitZoom();
+    setCenter(QPointF(center_.x() * ratio.width(), center_.y() * ratio.height()));
+    request();
+    update();
+}
+
+QSize ImageViewer::pictureSize() const {
+    if(opened_) return source_.info.size;
+    return preview_.isNull() ? QSize(1, 1) : preview_.size();
+}
+
+qreal ImageViewer::fitZoom() const {
+    QSize size = pictureSize();
+    return qMin(qreal(width()) / size.width(), qreal(height()) / size.height());
+}
+
+// the coarsest level fits in one tile
+int ImageViewer::levelCount() const {
+    QSize size  = pictureSize();
+    int   count = 1;
+    while((kTileEdge << (count - 1)) < qMax(size.width(), size.height())) ++count;
+    return count;
+}
+
+// the coarsest level which still has a pixel for every screen pixel
+int ImageViewer::level() const {
+    qreal zoom = zoom_ * devicePixelRatioF();
+    if(zoom >= 1) return 0;
+    return qBound(0, qFloor(std::log2(1 / zoom)), levelCount() - 1);
+}
+
+QRect ImageViewer::tileRegion(int level, int x, int y) const {
+    int step = kTileEdge << level;
+    return QRect(x * step, y * step, step, step) & QRect(QPoint(), pictureSize());
+}
+
+QRect ImageViewer::tilesOver(int level, QRectF const& region) const {
+    if(region.isEmpty()) return QRect();
+    qreal step   = kTileEdge << level;
+    QSize size   = levelSize(pictureSize(), level);
+    int   right  = (size.width() + kTileEdge - 1) / kTileEdge - 1;
+    int   bottom = (size.height() + kTileEdge - 1) / kTileEdge - 1;
+    QPoint first(qMax(0, qFloor(region.left() / step)), qMax(0, qFloor(region.top() / step)));
+    QPoint last(qMin(right, qCeil(region.right() / step) - 1), qMin(bottom, qCeil(region.bottom() / step) - 1));
+    return QRect(first, last);
+}
+
+QRectF ImageViewer::visibleRegion() const {
+    return QRectF(toPicture(QPointF(0, 0)), toPicture(QPointF(width(), height())))
+           & QRectF(QPointF(0, 0), QSizeF(pictureSize()));
+}
+
+QRectF ImageViewer::toScreen(QRectF const& region) const {
+    QPointF middle(width() / 2.0, height() / 2.0);
+    return QRectF((region.topLeft() - center_) * zoom_ + middle, region.size() * zoom_);
+}
+
+QPointF ImageViewer::toPicture(QPointF const& pos) const {
+    QPointF middle(width() / 2.0, height() / 2.0);
+    return (pos - middle) / zoom_ + center_;
+}
+
+// anchor is the screen point which stays on the same picture pixel
+void ImageViewer::setZoom(qreal zoom, QPointF const& anchor) {
+    qreal   fit    = fitZoom();
+    QPointF at     = toPicture(anchor);
+    QPointF middle = QPointF(width() / 2.0, height() / 2.0);
+    zoom_          = qBound(qMin(fit, 1 / devicePixelRatioF()), zoom, qMax(fit, kMaxZoom));
+    fitted_        = false;
+    setCenter(at - (anchor - middle) / zoom_);
+    request();
+    update();
+}
+
+// a picture smaller than the screen is centered, a bigger one never shows its outside
+void ImageViewer::setCenter(QPointF const& center) {
+    QSizeF size = pictureSize();
+    qreal  w    = width() / 2.0 / zoom_;
+    qreal  h    = height() / 2.0 / zoom_;
+    center_.setX(size.width() <= 2 * w ? size.width() / 2 : qBound(w, center.x(), size.width() - w));
+    center_.setY(size.height() <= 2 * h ? size.height() / 2 : qBound(h, center.y(), size.height() - h));
+}
+
+void ImageViewer::request() {
+    if(!opened_) return;
+    queue_.clear();
+
+    auto queue = [this](int level, QRect const& tiles, QRect const& skip) {
+        QVector<QPair<qreal, quint64>> keys;
+        for(int y = tiles.top(); y <= tiles.bottom(); ++y)
+            for(int x = tiles.left(); x <= tiles.right(); ++x) {
+                quint64 key = tileKey(level, x, y);
+                if(skip.contains(x, y) || tiles_.contains(key) || running_.contains(key)) continue;
+                QPointF d = QRectF(tileRegion(level, x, y)).center() - center_;
+                keys.append(qMakePair(d.x() * d.x() + d.y() * d.y(), key));
+            }
+        // nearest to the middle of the screen first
+        std::sort(keys.begin(), keys.end());
+        for(auto const& key: keys) queue_.append(key.second);
+    };
+
+    QRectF visible = visibleRegion();
+    int    level   = this->level();
+    QRect  tiles   = tilesOver(level, visible);
+    queue(level, tiles, QRect());
+    // one coarser level is cheap, it covers a quick zoom out
+    if(level + 1 < levelCount()) queue(level + 1, tilesOver(level + 1, visible), QRect());
+    // the ring around the screen for panning
+    qreal ring = kTileEdge << level;
+    queue(level, tilesOver(level, visible.adjusted(-ring, -ring, ring, ring)), tiles);
+    startJobs();
+}
+
+void ImageViewer::startJobs() {
+    while(running_.count() < pool_.maxThreadCount() && !queue_.isEmpty()) {
+        quint64 key    = queue_.takeFirst();
+        int     level  = int(key >> 48);
+        QRect   region = tileRegion(level, int(key & 0xffffff), int((key >> 24) & 0xffffff));
+        QSize   target = levelSize(region.size(), level);
+        running_.insert(key);
+        pool_.start([this, key, source = source_, region, target]() {
+            QImage       img = decode(source, region, target);
+            QMutexLocker locker(&resultsMutex_);
+            bool         wake = results_.isEmpty();
+            results_.append(Result { key, img });
+            if(wake) QMetaObject::invokeMethod(this, "drain", Qt::QueuedConnection);
+        });
+    }
+}
+
+void ImageViewer::drain() {
+    QVector<Result> batch;
+    {
+        QMutexLocker locker(&resultsMutex_);
+        batch.swap(results_);
+    }
+    for(auto const& result: batch) {
+        running_.remove(result.key);
+        if(result.img.isNull()) continue;
+        QPixmap pix = QPixmap::fromImage(result.img);
+        bytes_ += qint64(pix.width()) * pix.height() * pix.depth() / 8;
+        tiles_.insert(result.key, Tile { pix, ++shown_ });
+    }
+    evict();
+    startJobs();
+    update();
+}
+
+// drop the tiles shown least recently, the ones on the screen were shown by the last paint
+void ImageViewer::evict() {
+    qint64 capacity = qint64(TileBudget::instance()->cacheBudget()) * 1024 * 1024;
+    while(bytes_ > capacity && !tiles_.isEmpty()) {
+        auto oldest = tiles_.begin();
+        for(auto it = tiles_.begin(); it != tiles_.end(); ++it)
+            if(it->shown < oldest->shown) oldest = it;
+        bytes_ -= qint64(oldest->pix.width()) * oldest->pix.height() * oldest->pix.depth() / 8;
+        tiles_.erase(oldest);
+    }
+}
+
+void ImageViewer::paintEvent(QPaintEvent*) {
+    QPainter painter(this);
+    painter.fillRect(rect(), Qt::black);
+    painter.setRenderHint(QPainter::SmoothPixmapTransform);
+    QRectF picture(QPointF(0, 0), QSizeF(pictureSize()));
+    if(!preview_.isNull()) painter.drawPixmap(toScreen(picture), preview_, preview_.rect());
+    if(!opened_) return;
+
+    // coarser levels first, the finer tiles cover them where they are decoded
+    QRectF visible = visibleRegion();
+    int    level   = this->level();
+    for(int l = qMin(level + 2, levelCount() - 1); l >= level; --l) {
+        QRect tiles = tilesOver(l, visible);
+        for(int y = tiles.top(); y <= tiles.bottom(); ++y)
+            for(int x = tiles.left(); x <= tiles.right(); ++x) {
+                auto it = tiles_.find(tileKey(l, x, y));
+                if(it == tiles_.end()) continue;
+                it->shown = ++shown_;
+                painter.drawPixmap(toScreen(tileRegion(l, x, y)), it->pix, it->pix.rect());
+            }
+    }
+}
+
+void ImageViewer::resizeEvent(QResizeEvent* event) {
+    QWidget::resizeEvent(event);
+    if(fitted_) zoom_ = fitZoom();
+    setCenter(center_);
+    request();
+}
+
+void ImageViewer::wheelEvent(QWheelEvent* event) {
+    int delta = event->angleDelta().y();
+    if(delta == 0) return;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+    QPointF pos = event->position();
+#else
+    QPointF pos = event->posF();
+#endif
+    // one notch is 120, four of them double the zoom
+    setZoom(zoom_ * qPow(2, delta / 480.0), pos);
+}
+
+void ImageViewer::mousePressEvent(QMouseEvent* event) {
+    dragFrom_ = event->pos();
+}
+
+void ImageViewer::mouseMoveEvent(QMouseEvent* event) {
+    if(!(event->buttons() & Qt::LeftButton)) return;
+    QPointF delta = event->pos() - dragFrom_;
+    dragFrom_     = event->pos();
+    setCenter(center_ - delta / zoom_);
+    request();
+    update();
+}
+
+// toggle between the whole picture and one picture pixel by screen pixel
+void ImageViewer::mouseDoubleClickEvent(QMouseEvent* event) {
+    qreal actual = 1 / devicePixelRatioF();
+    if(fitted_ || zoom_ < actual) return setZoom(actual, event->pos());
+    fitted_ = true;
+    zoom_   = fitZoom();
+    setCenter(QPointF(pictureSize().width(), pictureSize().height()) / 2);
+    request();
+    update();
+}
+
+void ImageViewer::keyPressEvent(QKeyEvent* event) {
+    QPointF middle(width() / 2.0, height() / 2.0);
+    switch(event->key()) {
+        case Qt::Key_Escape: close(); break;
+        case Qt::Key_Plus:
+        case Qt::Key_Equal: setZoom(zoom_ * 2, middle); break;
+        case Qt::Key_Minus: setZoom(zoom_ / 2, middle); break;
+        default: QWidget::keyPressEvent(event);
+    }
+}
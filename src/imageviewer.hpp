@@ -0,0 +1,128 @@
+/* ============================================================
+ *
+ * This file is a part of digiKam flow plugin project
+ * https://github.com/cathaysia/digikamflowplugin
+ *
+ * Date        : 2021-05-22
+ * Description : Full screen viewer decoding the visible region of a picture.
+ *
+ * Copyright (C) 2021-2022 by DragonBillow <DragonBillow at outlook dot com>
+ *
+ * Redistribution and use is allowed according to the terms of the GPL3 license.
+ * For details see the accompanying LICENSE file.
+ *
+ * ============================================================ */
+
+#pragma once
+
+#include <QHash>
+#include <QImage>
+#include <QMutex>
+#include <QPixmap>
+#include <QSet>
+#include <QThreadPool>
+#include <QUrl>
+#include <QVector>
+#include <QWidget>
+
+#include "tileinfo.hpp"
+
+/**
+ * ImageViewer shows one picture full screen with zoom and pan. The picture is
+ * cut in tiles of 512 pixels at levels of 1, 1/2, 1/4... of its resolution,
+ * and only the tiles over the screen, at the level the zoom needs, are decoded:
+ * QImageReader reads the clip rect of the tile scaled down to its level, which
+ * JPEG does without decoding the rest. A ring of tiles around the screen is
+ * decoded after the visible ones, so panning finds them ready.
+ *
+ * Formats which can not read a clip rect are decoded once, by Qt or digikam,
+ * and the tiles are cut from that picture.
+ *
+ * Decoded tiles are kept up to the share of the memory budget TileBudget gives
+ * the viewer, the least recently shown are dropped first. The preview, and the
+ * tiles of coarser levels, cover the tiles which are not decoded yet.
+ */
+class ImageViewer : public QWidget {
+    Q_OBJECT;
+
+public:
+    // preview is shown until the tiles of url are decoded
+    ImageViewer(QImage const& preview, QUrl const& url, QWidget* parent = nullptr);
+    // drops the queued tiles and waits for the running ones
+    ~ImageViewer() override;
+
+protected:
+    void paintEvent(QPaintEvent* event) override;
+    void resizeEvent(QResizeEvent* event) override;
+    void wheelEvent(QWheelEvent* event) override;
+    void mousePressEvent(QMouseEvent* event) override;
+    void mouseMoveEvent(QMouseEvent* event) override;
+    void mouseDoubleClickEvent(QMouseEvent* event) override;
+    void keyPressEvent(QKeyEvent* event) override;
+
+private slots:
+    void drain();
+
+private:
+    // what a worker needs to decode a tile
+    struct Source {
+        QString  path;
+        TileInfo info;
+        // the whole picture, oriented and in the work format of Resampler, when the format can not read a clip rect
+        QImage full;
+    };
+    struct Tile {
+        QPixmap pix;
+        quint64 shown;
+    };
+    struct Result {
+        quint64 key;
+        QImage  img;
+    };
+
+    // runs on a worker, reads the header or decodes the whole picture
+    static Source load(QString const& path);
+    // runs on a worker, region is in picture pixels
+    static QImage decode(Source const& source, QRect const& region, QSize const& target);
+
+    void opened(Source const& source);
+    // queue the tiles around the screen, visible ones first
+    void request();
+    void startJobs();
+    void evict();
+
+    QSize   pictureSize() const;
+    qreal   fitZoom() const;
+    int     levelCount() const;
+    int     level() const;
+    QRect   tileRegion(int level, int x, int y) const;
+    // tiles of level over the picture region, in tile coordinates
+    QRect   tilesOver(int level, QRectF const& region) const;
+    QRectF  visibleRegion() const;
+    QRectF  toScreen(QRectF const& region) const;
+    QPointF toPicture(QPointF const& pos) const;
+    void    setZoom(qreal zoom, QPointF const& anchor);
+    void    setCenter(QPointF const& center);
+
+    QUrl    url_;
+    QPixmap preview_;
+    Source  source_;
+    bool    opened_ = false;
+
+    // screen pixels by picture pixel, center_ is in picture pixels
+    qreal   zoom_ = 1;
+    QPointF center_;
+    // the zoom follows the size of the screen until the user zooms
+    bool    fitted_ = true;
+    QPoint  dragFrom_;
+
+    QThreadPool          pool_;
+    QHash<quint64, Tile> tiles_;
+    qint64               bytes_ = 0;
+    // paint counter, the least recently shown tiles are evicted first
+    quint64              shown_ = 0;
+    QVector<quint64>     queue_;
+    QSet<quint64>        running_;
+    QMutex               resultsMutex_;
+    QVector<Result>      results_;
+};
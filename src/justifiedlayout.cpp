@@ -0,0 +1,172 @@
+/* ============================================================
+ *
+ * This file is a part of digiKam flow plugin project
+ * https://github.com/cathaysia/digikamflowplugin
+ *
+ * Date        : 2021-05-22
+ * Description : Justified rows with optimal line breaking.
+ *
+ * Copyright (C) 2021-2022 by DragonBillow <DragonBillow at outlook dot com>
+ *
+ * Redistribution and use is allowed according to the terms of the GPL3 license.
+ * For details see the accompanying LICENSE file.
+ *
+ * ============================================================ */
+
+#include "justifiedlayout.hpp"
+
+#include <algorithm>
+#include <limits>
+
+#include <QtMath>
+
+// a row shrinks to at most half of the reference height, a single picture may break this
+constexpr qreal kMinScale = 0.5;
+// bounds the window even with a very small reference height
+constexpr int kMaxRowItems = 256;
+
+void JustifiedLayout::setWidth(int width) {
+    width = std::max(width, 0);
+    if(width_ != width) solved_ = 0;
+    width_ = width;
+}
+
+void JustifiedLayout::setSpacing(int spacing) {
+    spacing = std::max(spacing, 0);
+    if(spacing_ != spacing) solved_ = 0;
+    spacing_ = spacing;
+}
+
+void JustifiedLayout::setReferenceHeight(qreal height) {
+    height = std::max<qreal>(height, 1);
+    if(!qFuzzyCompare(refH_, height)) solved_ = 0;
+    refH_ = height;
+}
+
+void JustifiedLayout::clear() {
+    ratios_.clear();
+    prefix_.clear();
+    rows_.clear();
+    solved_ = 0;
+}
+
+void JustifiedLayout::append(qreal ratio) {
+    if(prefix_.isEmpty()) prefix_.append(0);
+    ratios_.append(float(ratio));
+    prefix_.append(prefix_.last() + ratios_.last());
+}
+
+// the rows before index keep their cost, the prefix sums after it change
+void JustifiedLayout::setRatio(int index, qreal ratio) {
+    if(index < 0 || index >= ratios_.count()) return;
+    ratios_[index] = float(ratio);
+    for(int i = index; i < ratios_.count(); ++i) prefix_[i + 1] = prefix_[i] + ratios_[i];
+    solved_ = std::min(solved_, index + 1);
+}
+
+int JustifiedLayout::count() const {
+    return ratios_.count();
+}
+
+qreal JustifiedLayout::ratio(int index) const {
+    return ratios_.value(index, 1);
+}
+
+QVector<int> const& JustifiedLayout::rowStarts() const {
+    return rows_;
+}
+
+qint64 JustifiedLayout::candidates() const {
+    return candidates_;
+}
+
+// height of the pictures [begin, end) stretched to the width, 0 when the gaps alone are wider
+qreal JustifiedLayout::rowHeight(int begin, int end) const {
+    qreal avail = width_ - spacing_ * (end - begin - 1);
+    qreal sum   = prefix_[end] - prefix_[begin];
+    return avail > 0 && sum > 0 ? avail / sum : 0;
+}
+
+double JustifiedLayout::rowCost(int begin, int end) const {
+    double d = (rowHeight(begin, end) - refH_) / refH_;
+    return d * d;
+}
+
+// Rows only get shorter when they begin earlier, so the window stops at the first one under half height
+void JustifiedLayout::solve() {
+    int n = ratios_.count();
+    best_.resize(n + 1);
+    from_.resize(n + 1);
+    if(!solved_) {
+        best_[0] = 0;
+        from_[0] = 0;
+        solved_  = 1;
+    }
+    double const minH = refH_ * kMinScale;
+    for(int end = solved_; end <= n; ++end) {
+        double best = std::numeric_limits<double>::max();
+        int    from = end - 1;
+        for(int begin = end - 1; begin >= std::max(0, end - kMaxRowItems); --begin) {
+            ++candidates_;
+            // rowHeight() without the division
+            double avail = width_ - spacing_ * (end - begin - 1);
+            if(begin < end - 1 && avail < minH * (prefix_[end] - prefix_[begin])) break;
+            double cost = best_[begin] + rowCost(begin, end);
+            if(cost < best) {
+                best = cost;
+                from = begin;
+            }
+        }
+        best_[end] = best;
+        from_[end] = from;
+    }
+    solved_ = n + 1;
+}
+
+int JustifiedLayout::update(QVector<QRect>& rects) {
+    int n = ratios_.count();
+    rects.resize(n);
+    rows_.clear();
+    candidates_ = 0;
+    if(!n || width_ <= 0) return 0;
+    solve();
+
+    // the last row costs nothing when it fits unstretched
+    double best = std::numeric_limits<double>::max();
+    int    last = n - 1;
+    for(int begin = n - 1; begin >= std::max(0, n - kMaxRowItems); --begin) {
+        ++candidates_;
+        qreal  natural = (prefix_[n] - prefix_[begin]) * refH_ + spacing_ * (n - begin - 1);
+        double cost    = best_[begin];
+        if(natural > width_) {
+            if(begin < n - 1 && rowHeight(begin, n) < refH_ * kMinScale) break;
+            cost += rowCost(begin, n);
+        }
+        if(cost < best) {
+            best = cost;
+            last = begin;
+        }
+    }
+    for(int begin = last; begin > 0; begin = from_[begin]) rows_.append(begin);
+    rows_.append(0);
+    std::reverse(rows_.begin(), rows_.end());
+
+    int y = 0;
+    for(int r = 0; r < rows_.count(); ++r) {
+        int   begin   = rows_.at(r);
+        int   end     = r + 1 < rows_.count() ? rows_.at(r + 1) : n;
+        qreal sum     = prefix_[end] - prefix_[begin];
+        bool  full    = end < n || sum * refH_ + spacing_ * (end - begin - 1) > width_;
+        qreal rowH    = full ? rowHeight(begin, end) : refH_;
+        int   rowHInt = std::max(1, qRound(rowH));
+        int   x       = 0;
+        for(int i = begin; i < end; ++i) {
+            int w = std::max(1, qRound(ratios_.at(i) * rowH));
+            if(full && i == end - 1) w = std::max(1, width_ - x);
+            rects[i] = QRect(x, y, w, rowHInt);
+            x += w + spacing_;
+        }
+        y += rowHInt + spacing_;
+    }
+    return y - spacing_;
+}
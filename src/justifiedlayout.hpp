@@ -0,0 +1,74 @@
+/* ============================================================
+ *
+ * This file is a part of digiKam flow plugin project
+ * https://github.com/cathaysia/digikamflowplugin
+ *
+ * Date        : 2021-05-22
+ * Description : Justified rows with optimal line breaking.
+ *
+ * Copyright (C) 2021-2022 by DragonBillow <DragonBillow at outlook dot com>
+ *
+ * Redistribution and use is allowed according to the terms of the GPL3 license.
+ * For details see the accompanying LICENSE file.
+ *
+ * ============================================================ */
+
+#pragma once
+
+#include <QRect>
+#include <QVector>
+
+/**
+ * JustifiedLayout breaks pictures into rows stretched to the full width, and
+ * chooses the breaks of all rows together, like Knuth-Plass does for words:
+ * the sum over the rows of ((row height - reference height) / reference)^2 is
+ * the smallest possible. A greedy fill often leaves one row much taller or
+ * shorter than the others; this never does when a better split exists.
+ *
+ * Only the aspect ratios are kept, in one packed array with their prefix sums.
+ * A row of more than one picture is never shorter than half the reference
+ * height, so the candidate starts of a row are a small window and the whole
+ * pass is linear. There is no upper bound, a row of one very narrow picture
+ * is as tall as the width makes it. The best
+ * cost of every prefix is kept, appending only computes the new pictures.
+ * The last row is not stretched when it is shorter than the width.
+ */
+class JustifiedLayout {
+public:
+    void setWidth(int width);
+    void setSpacing(int spacing);
+    void setReferenceHeight(qreal height);
+
+    void clear();
+    // width / height of a picture
+    void  append(qreal ratio);
+    void  setRatio(int index, qreal ratio);
+    int   count() const;
+    qreal ratio(int index) const;
+
+    // break the rows and write one rect per picture, returns the height
+    int update(QVector<QRect>& rects);
+    // first picture of every row of the last update
+    QVector<int> const& rowStarts() const;
+    // row starts the last update weighed, about a constant times the pictures it solved
+    qint64 candidates() const;
+
+private:
+    void   solve();
+    qreal  rowHeight(int begin, int end) const;
+    double rowCost(int begin, int end) const;
+
+    int             width_   = 0;
+    int             spacing_ = 0;
+    qreal           refH_    = 300;
+    QVector<float>  ratios_;
+    // prefix_[i] is the sum of ratios_ before i
+    QVector<double> prefix_;
+    // best_[i] is the smallest cost of the pictures before i in full rows, from_[i] where its last row begins
+    QVector<double> best_;
+    QVector<int>    from_;
+    // best_ and from_ are valid up to here
+    int          solved_     = 0;
+    QVector<int> rows_;
+    qint64       candidates_ = 0;
+};
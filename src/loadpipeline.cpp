@@ -0,0 +1,285 @@
+/* ============================================================
+ *
+ * This file is a part of digiKam flow plugin project
+ * https://github.com/cathaysia/digikamflowplugin
+ *
+ * Date        : 2021-05-22
+ * Description : Read, decode and scale pictures in separate stages.
+ *
+ * Copyright (C) 2021-2022 by DragonBillow <DragonBillow at outlook dot com>
+ *
+ * Redistribution and use is allowed according to the terms of the GPL3 license.
+ * For details see the accompanying LICENSE file.
+ *
+ * ============================================================ */
+
+#include "loadpipeline.hpp"
+
+#include <QBuffer>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QMutexLocker>
+#include <QThread>
+#include <QtMath>
+
+#include "digikam_debug.h"
+#include "drawdecoder.h"
+#include "metaengine_previews.h"
+#include "profiler.hpp"
+#include "resampler.hpp"
+#include "thumbcache.hpp"
+
+// waiting on a network share costs no CPU, so reading may use more threads than cores
+constexpr int    kMaxReadThreads = 16;
+constexpr double kSmoothing      = 0.2;
+// the smallest level, edge of the low resolution pictures
+constexpr int kLowEdge = 256;
+
+// JPEG decodes to a fraction of its size cheaply, its embedded preview only pays off when much bigger
+inline bool worthPreview(QString const& path, QSize const& source, int edge) {
+    static QStringList const raws = []() {
+        QStringList list;
+        for(auto& it: Digikam::DRawDecoder::rawFilesList().split(QLatin1Char(' ')))
+            if(it.startsWith(QLatin1String("*."))) list << it.mid(2);
+        return list;
+    }();
+    if(raws.contains(QFileInfo(path).suffix(), Qt::CaseInsensitive)) return true;
+    return qMax(source.width(), source.height()) >= 4 * edge;
+}
+
+LoadPipeline::LoadPipeline(ThumbCache* cache, Deliver deliver)
+    : cache_(cache)
+    , deliver_(std::move(deliver))
+    , stop_(false)
+    , readThreads_(0)
+    , depth_(8)
+    , embedded_(true) {
+    int cores = QThread::idealThreadCount();
+    pools_[Read].setMaxThreadCount(kMaxReadThreads);
+    pools_[Decode].setMaxThreadCount(cores);
+    pools_[Scale].setMaxThreadCount(cores);
+    for(int i = 0; i < StageCount; ++i) {
+        running_[i] = 0;
+        latency_[i] = 0;
+    }
+    limits_[Read]   = 2;
+    limits_[Decode] = cores;
+    limits_[Scale]  = 1;
+}
+
+LoadPipeline::~LoadPipeline() {
+    stop_ = true;
+    {
+        QMutexLocker locker(&mutex_);
+        for(auto& queue: queues_) queue.clear();
+    }
+    for(auto& pool: pools_) pool.waitForDone();
+}
+
+void LoadPipeline::setReadThreads(int count) {
+    QMutexLocker locker(&mutex_);
+    readThreads_ = qBound(0, count, kMaxReadThreads);
+    if(readThreads_) limits_[Read] = readThreads_;
+    pump();
+}
+
+void LoadPipeline::setDecodeThreads(int count) {
+    QMutexLocker locker(&mutex_);
+    limits_[Decode] = count > 0 ? count : QThread::idealThreadCount();
+    pools_[Decode].setMaxThreadCount(limits_[Decode]);
+    pump();
+}
+
+void LoadPipeline::setDepth(int depth) {
+    QMutexLocker locker(&mutex_);
+    depth_ = qMax(depth, 1);
+    pump();
+}
+
+void LoadPipeline::setEmbeddedPreviews(bool enable) {
+    embedded_ = enable;
+}
+
+int LoadPipeline::capacity() const {
+    QMutexLocker locker(&mutex_);
+    return limits_[Read] + limits_[Decode] + limits_[Scale] + depth_;
+}
+
+void LoadPipeline::enqueue(int index, TileInfo const& info, int edge, qint64 queued) {
+    QMutexLocker locker(&mutex_);
+    queues_[Read].enqueue(
+        Job { index, info.url.toLocalFile(), info, edge, queued, QByteArray(), QImage(), false, false });
+    pump();
+}
+
+bool LoadPipeline::cancel(int index) {
+    QMutexLocker locker(&mutex_);
+    auto&        queue = queues_[Read];
+    for(int i = 0; i < queue.count(); ++i) {
+        if(queue.at(i).index != index) continue;
+        queue.removeAt(i);
+        return true;
+    }
+    return false;
+}
+
+// the queue behind a stage must have room for every job the stage is running
+bool LoadPipeline::hasRoom(Stage stage) const {
+    if(stage == Scale) return true;
+    return queues_[stage + 1].count() + running_[stage] < depth_;
+}
+
+// Called with the mutex held. Later stages go first, they free room for the earlier ones
+void LoadPipeline::pump() {
+    if(stop_) return;
+    for(int i = StageCount - 1; i >= 0; --i) {
+        auto stage = Stage(i);
+        while(!queues_[stage].isEmpty() && running_[stage] < limits_[stage] && hasRoom(stage)) {
+            ++running_[stage];
+            pools_[stage].start([this, stage, job = queues_[stage].dequeue()]() mutable {
+                this->run(stage, std::move(job));
+            });
+        }
+    }
+}
+
+void LoadPipeline::run(Stage stage, Job job) {
+    QElapsedTimer timer;
+    timer.start();
+    bool forward = false;
+    if(!stop_) {
+        switch(stage) {
+            case Read: forward = read(job); break;
+            case Decode: forward = decode(job); break;
+            case Scale: forward = scale(job); break;
+            default: break;
+        }
+    }
+    finish(stage, job, timer.nsecsElapsed() / 1000, forward);
+}
+
+void LoadPipeline::finish(Stage stage, Job& job, qint64 latency, bool forward) {
+    QMutexLocker locker(&mutex_);
+    --running_[stage];
+    latency_[stage] = latency_[stage] ? latency_[stage] + kSmoothing * (latency - latency_[stage]) : latency;
+    if(forward && !stop_) queues_[stage + 1].enqueue(std::move(job));
+    adapt();
+    pump();
+}
+
+// Little's law: to keep n decoders busy, a stage needs n * its latency / decode latency jobs in flight
+void LoadPipeline::adapt() {
+    if(latency_[Decode] <= 0) return;
+    qreal ratio = limits_[Decode] / latency_[Decode];
+    if(!readThreads_) limits_[Read] = qBound(1, qCeil(ratio * latency_[Read]), kMaxReadThreads);
+    limits_[Scale] = qBound(1, qCeil(ratio * latency_[Scale]), pools_[Scale].maxThreadCount());
+}
+
+bool LoadPipeline::read(Job& job) {
+    auto* profiler = Profiler::instance();
+    profiler->record("wait", job.queued, profiler->now(), job.index);
+    Profiler::Scope scope("read", job.index);
+
+    QImage img = cache_ ? cache_->find(job.info, QSize(job.edge, job.edge)) : QImage();
+    if(!img.isNull()) {
+        deliver_(job.index, img, true);
+        return false;
+    }
+    if(cache_ && job.edge > kLowEdge) {
+        img = cache_->find(job.info, QSize(kLowEdge, kLowEdge));
+        job.low = !img.isNull();
+        if(job.low) deliver_(job.index, img, false);
+    }
+
+    if(embedded_ && worthPreview(job.path, job.info.size, job.edge) && readPreview(job)) return true;
+
+    // the whole file is read ahead, the decoder never waits for the disk
+    QFile file(job.path);
+    if(file.open(QIODevice::ReadOnly)) job.data = file.readAll();
+    if(job.data.isEmpty()) {
+        qCDebug(DIGIKAM_DPLUGIN_GENERIC_LOG) << "Image " << job.path << " read failed";
+        deliver_(job.index, QImage(), true);
+        return false;
+    }
+    return true;
+}
+
+// The smallest embedded preview which still covers the edge, the decode stage decodes it like a file
+bool LoadPipeline::readPreview(Job& job) {
+    Profiler::Scope             scope("preview", job.index);
+    Digikam::MetaEnginePreviews previews(job.path);
+
+    int best = -1, bestEdge = 0;
+    for(int i = 0; i < previews.count(); ++i) {
+        int edge = qMax(previews.width(i), previews.height(i));
+        if(edge < job.edge || (best >= 0 && edge >= bestEdge)) continue;
+        best     = i;
+        bestEdge = edge;
+    }
+    if(best < 0) return false;
+
+    job.data    = previews.data(best);
+    job.preview = !job.data.isEmpty();
+    return job.preview;
+}
+
+bool LoadPipeline::decode(Job& job) {
+    Profiler::Scope scope("decode", job.index);
+
+    QBuffer buffer(&job.data);
+    buffer.open(QIODevice::ReadOnly);
+    QImageReader reader(&buffer);
+    reader.setAutoTransform(!job.preview);
+    // decode straight to the needed size, jpeg uses DCT scaling for this
+    QSize size = reader.size();
+    if(size.isValid() && qMax(size.width(), size.height()) > job.edge)
+        reader.setScaledSize(size.scaled(job.edge, job.edge, Qt::KeepAspectRatio));
+    // previews are small already, other formats would decode at full size twice
+    if(!job.low && !job.preview && job.edge > kLowEdge && reader.format() == "jpeg") decodeLow(job);
+    job.img = reader.read();
+    buffer.close();
+    job.data.clear();
+    if(job.preview) job.img = TileInfo::oriented(job.img, job.info.orientation);
+
+    if(job.img.isNull()) {
+        qCDebug(DIGIKAM_DPLUGIN_GENERIC_LOG) << "Image " << job.path << " load failed";
+        deliver_(job.index, QImage(), true);
+        return false;
+    }
+    return true;
+}
+
+// 1/8 DCT scaling skips most of the work of a full decode
+void LoadPipeline::decodeLow(Job& job) {
+    Profiler::Scope scope("low", job.index);
+
+    QBuffer buffer(&job.data);
+    buffer.open(QIODevice::ReadOnly);
+    QImageReader reader(&buffer, "jpeg");
+    reader.setAutoTransform(true);
+    QSize size = reader.size();
+    if(!size.isValid() || qMax(size.width(), size.height()) <= 2 * kLowEdge) return;
+    reader.setScaledSize(size.scaled(kLowEdge, kLowEdge, Qt::KeepAspectRatio));
+    QImage img = reader.read();
+    if(img.isNull()) return;
+
+    job.low = true;
+    deliver_(job.index, img, false);
+    if(cache_) cache_->insert(job.info, QSize(kLowEdge, kLowEdge), img);
+}
+
+bool LoadPipeline::scale(Job& job) {
+    Profiler::Scope scope("scale", job.index);
+
+    QSize target(job.edge, job.edge);
+    // formats without scaled decoding come out at full size
+    job.img = Resampler::fitted(job.img, target);
+    if(cache_) {
+        cache_->insert(job.info, target, job.img);
+        cache_->setColor(job.path, Resampler::average(job.img));
+    }
+    deliver_(job.index, job.img, true);
+    return false;
+}
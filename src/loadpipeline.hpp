@@ -0,0 +1,116 @@
+/* ============================================================
+ *
+ * This file is a part of digiKam flow plugin project
+ * https://github.com/cathaysia/digikamflowplugin
+ *
+ * Date        : 2021-05-22
+ * Description : Read, decode and scale pictures in separate stages.
+ *
+ * Copyright (C) 2021-2022 by DragonBillow <DragonBillow at outlook dot com>
+ *
+ * Redistribution and use is allowed according to the terms of the GPL3 license.
+ * For details see the accompanying LICENSE file.
+ *
+ * ============================================================ */
+
+#pragma once
+
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QImage>
+#include <QMutex>
+#include <QQueue>
+#include <QString>
+#include <QThreadPool>
+
+#include <functional>
+
+#include "tileinfo.hpp"
+
+class ThumbCache;
+
+/**
+ * LoadPipeline is the custom loader. Reading a file waits for the disk or the
+ * network, decoding and scaling wait for the CPU, so each of them has its own
+ * threads and queue:
+ *
+ *   read (file bytes) -> decode (QImageReader) -> scale (Resampler, disk cache)
+ *
+ * A stage only takes a job when the queue behind it has room, so a fast disk
+ * never piles up more than depth files in memory. Decode threads follow the
+ * setting or the cores; read and scale threads follow the measured latencies,
+ * to keep the decode threads fed, unless the read threads are set.
+ *
+ * A tile bigger than the smallest level gets a low resolution picture first,
+ * from the disk cache or a cheap DCT scaled decode of the JPEG already read,
+ * so it is never empty while the final picture is decoded.
+ */
+class LoadPipeline {
+public:
+    // thread safe, img is null when the picture can not be loaded,
+    // final is false for the low resolution picture which comes before
+    using Deliver = std::function<void(int index, QImage const& img, bool final)>;
+
+    LoadPipeline(ThumbCache* cache, Deliver deliver);
+    // drops the queued jobs and waits for the running ones
+    ~LoadPipeline();
+
+    // 0 means automatic
+    void setReadThreads(int count);
+    void setDecodeThreads(int count);
+    // pictures waiting between two stages
+    void setDepth(int depth);
+    // use the preview embedded in RAW and big JPEG files when it covers the edge
+    void setEmbeddedPreviews(bool enable);
+    // jobs which can be in the pipeline without waiting in front of it
+    int capacity() const;
+
+    // queued is the time the tile was queued, for Profiler
+    void enqueue(int index, TileInfo const& info, int edge, qint64 queued = -1);
+    // drop the job of index if it is not read yet, true when it was dropped and will not be delivered
+    bool cancel(int index);
+
+private:
+    struct Job {
+        int        index;
+        QString    path;
+        TileInfo   info;
+        int        edge;
+        qint64     queued;
+        QByteArray data;
+        QImage     img;
+        // data is an embedded preview, it has no EXIF orientation
+        bool preview;
+        // a low resolution picture was delivered
+        bool low;
+    };
+
+    enum Stage { Read, Decode, Scale, StageCount };
+
+    void pump();
+    void run(Stage stage, Job job);
+    void finish(Stage stage, Job& job, qint64 latency, bool forward);
+    void adapt();
+    bool hasRoom(Stage stage) const;
+
+    // false when the job is done, delivered or failed
+    bool read(Job& job);
+    bool readPreview(Job& job);
+    bool decode(Job& job);
+    void decodeLow(Job& job);
+    bool scale(Job& job);
+
+    ThumbCache*    cache_;
+    Deliver        deliver_;
+    QAtomicInt     stop_;
+    mutable QMutex mutex_;
+    QThreadPool    pools_[StageCount];
+    QQueue<Job>    queues_[StageCount];
+    int            running_[StageCount];
+    int            limits_[StageCount];
+    // moving average of a job, in microseconds
+    double         latency_[StageCount];
+    int            readThreads_;
+    int            depth_;
+    QAtomicInt     embedded_;
+};
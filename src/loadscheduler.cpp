@@ -0,0 +1,190 @@
+/* ============================================================
+ *
+ * This file is a part of digiKam flow plugin project
+ * https://github.com/cathaysia/digikamflowplugin
+ *
+ * Date        : 2021-05-22
+ * Description : Load pictures near the viewport first.
+ *
+ * Copyright (C) 2021-2022 by DragonBillow <DragonBillow at outlook dot com>
+ *
+ * Redistribution and use is allowed according to the terms of the GPL3 license.
+ * For details see the accompanying LICENSE file.
+ *
+ * ============================================================ */
+
+#include "loadscheduler.hpp"
+
+#include <QTimer>
+
+#include <QtMath>
+
+#include <algorithm>
+
+constexpr double kSmoothing = 0.3;
+// a viewport which did not move for this long stands still
+constexpr qint64 kStillInterval = 250;
+// tiles are requested this long before they are visible, at least and at most
+constexpr double kMinLookahead = 200;
+constexpr double kMaxLookahead = 2000;
+// a tile behind the scroll direction counts as this much farther
+constexpr int kBehindFactor = 4;
+
+LoadScheduler::LoadScheduler(Geometry geometry, QObject* parent)
+    : QObject(parent)
+    , geometry_(std::move(geometry))
+    , cursor_(0)
+    , maxInFlight_(1)
+    , horizonFactor_(3)
+    , backgroundFill_(false)
+    , dirty_(false)
+    , scheduled_(false)
+    , movedAt_(0)
+    , velocity_(0)
+    , latency_(kMinLookahead)
+    , lookahead_(0) {
+    clock_.start();
+}
+
+void LoadScheduler::setMaxInFlight(int count) {
+    maxInFlight_ = std::max(count, 1);
+    scheduleLater();
+}
+
+int LoadScheduler::maxInFlight() const {
+    return maxInFlight_;
+}
+
+void LoadScheduler::setHorizonFactor(int factor) {
+    horizonFactor_ = std::max(factor, 1);
+    scheduleLater();
+}
+
+void LoadScheduler::setBackgroundFill(bool fill) {
+    backgroundFill_ = fill;
+    scheduleLater();
+}
+
+void LoadScheduler::enqueue(int index, QUrl const& url) {
+    if(inFlight_.contains(index)) {
+        if(stale_.contains(index)) again_.insert(index, url);
+        return;
+    }
+    pending_.insert(index, url);
+    dirty_ = true;
+    scheduleLater();
+}
+
+void LoadScheduler::invalidate(int index) {
+    if(inFlight_.contains(index)) stale_.insert(index);
+}
+
+void LoadScheduler::cancel(int index) {
+    // sorted queue skips the indexes which are not pending any more
+    pending_.remove(index);
+    again_.remove(index);
+}
+
+void LoadScheduler::clear() {
+    pending_.clear();
+    again_.clear();
+    order_.clear();
+    cursor_ = 0;
+}
+
+int LoadScheduler::pending() const {
+    return pending_.count();
+}
+
+int LoadScheduler::lookahead() const {
+    return lookahead_;
+}
+
+void LoadScheduler::setViewport(QRect const& viewport) {
+    qint64 now = clock_.elapsed();
+    qint64 dt  = now - movedAt_;
+    if(viewport.top() != viewport_.top() && viewport.height() == viewport_.height() && dt > 0) {
+        double v  = double(viewport.top() - viewport_.top()) / dt;
+        velocity_ = dt > kStillInterval ? v : velocity_ + kSmoothing * (v - velocity_);
+        movedAt_  = now;
+    } else if(dt > kStillInterval) {
+        velocity_ = 0;
+    }
+    viewport_ = viewport;
+    dirty_    = true;
+    updateLookahead();
+    scheduleLater();
+}
+
+void LoadScheduler::finished(int index) {
+    auto it = inFlight_.find(index);
+    if(it != inFlight_.end()) {
+        latency_ += kSmoothing * (clock_.elapsed() - it.value() - latency_);
+        inFlight_.erase(it);
+    }
+    stale_.remove(index);
+    if(again_.contains(index)) {
+        pending_.insert(index, again_.take(index));
+        dirty_ = true;
+    }
+    scheduleLater();
+}
+
+// How far the viewport travels while a load takes, within the horizon
+void LoadScheduler::updateLookahead() {
+    double time  = qBound(kMinLookahead, latency_, kMaxLookahead);
+    int    limit = horizonFactor_ * std::max(viewport_.height(), 1);
+    int    px    = qBound(-limit, qRound(velocity_ * time), limit);
+    // small changes are not worth a new band
+    if(px == lookahead_ || (px && qAbs(px - lookahead_) < viewport_.height() / 8)) return;
+    lookahead_ = px;
+    emit lookaheadChanged(px);
+}
+
+// vertical gap between a tile and the viewport, 0 if visible; tiles behind the scroll direction count farther
+int LoadScheduler::distance(int index) const {
+    QRect rect = geometry_(index);
+    int   gap  = 0;
+    if(rect.top() > viewport_.bottom()) gap = rect.top() - viewport_.bottom();
+    if(rect.bottom() < viewport_.top()) gap = rect.bottom() - viewport_.top();
+    if(!gap || !lookahead_ || (gap > 0) == (lookahead_ > 0)) return qAbs(gap);
+    return qAbs(gap) * kBehindFactor + viewport_.height();
+}
+
+void LoadScheduler::resort() {
+    order_.clear();
+    order_.reserve(pending_.count());
+    for(auto it = pending_.cbegin(); it != pending_.cend(); ++it)
+        order_.append(qMakePair(distance(it.key()), it.key()));
+    std::sort(order_.begin(), order_.end());
+    cursor_ = 0;
+    dirty_  = false;
+}
+
+// Loaders may run synchronously and dispatch again, so never schedule recursively
+void LoadScheduler::scheduleLater() {
+    if(scheduled_) return;
+    scheduled_ = true;
+    QTimer::singleShot(0, this, &LoadScheduler::schedule);
+}
+
+void LoadScheduler::schedule() {
+    scheduled_ = false;
+    if(dirty_) resort();
+
+    int horizon = horizonFactor_ * std::max(viewport_.height(), 1) + qAbs(lookahead_);
+    while(inFlight_.count() < maxInFlight_ && cursor_ < order_.count()) {
+        auto item = order_.at(cursor_);
+        if(!pending_.contains(item.second)) {
+            ++cursor_;
+            continue;
+        }
+        // the queue is sorted, everything after this one is farther
+        if(item.first > horizon && !backgroundFill_) break;
+
+        ++cursor_;
+        QUrl url = pending_.take(item.second);
+        inFlight_.insert(item.second, clock_.elapsed());
+        emit dispatch(item.second, url);
+    }
+}
@@ -0,0 +1,102 @@
+/* ============================================================
+ *
+ * This file is a part of digiKam flow plugin project
+ * https://github.com/cathaysia/digikamflowplugin
+ *
+ * Date        : 2021-05-22
+ * Description : Load pictures near the viewport first.
+ *
+ * Copyright (C) 2021-2022 by DragonBillow <DragonBillow at outlook dot com>
+ *
+ * Redistribution and use is allowed according to the terms of the GPL3 license.
+ * For details see the accompanying LICENSE file.
+ *
+ * ============================================================ */
+
+#pragma once
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QObject>
+#include <QPair>
+#include <QRect>
+#include <QSet>
+#include <QUrl>
+#include <QVector>
+
+#include <functional>
+
+/**
+ * LoadScheduler keeps the pending loads and only hands a few of them to the
+ * loader at a time, nearest to the viewport first. When the viewport moves the
+ * queue is re-sorted, and pending loads farther than the horizon are held back.
+ *
+ * It also follows how the viewport moves. Tiles ahead of the scroll direction
+ * go first, tiles behind it wait. lookahead() is how far the viewport will
+ * travel while a load takes, as measured from dispatch to finish, so the view
+ * can request the tiles there before they are visible.
+ */
+class LoadScheduler : public QObject {
+    Q_OBJECT;
+
+public:
+    // geometry of a tile, in the same coordinate as the viewport
+    using Geometry = std::function<QRect(int index)>;
+
+    explicit LoadScheduler(Geometry geometry, QObject* parent = nullptr);
+
+    // how many loads can be dispatched but not finished
+    void setMaxInFlight(int count);
+    int  maxInFlight() const;
+    // loads farther than factor * viewport height wait until the viewport comes near
+    void setHorizonFactor(int factor);
+    // also dispatch the loads behind the horizon when nothing near is pending
+    void setBackgroundFill(bool fill);
+
+    void enqueue(int index, QUrl const& url);
+    // the load of index in flight is outdated, the next enqueue() of index loads it again once it finished
+    void invalidate(int index);
+    void cancel(int index);
+    void clear();
+    int  pending() const;
+    // pixels the viewport travels in the time of a load, negative when scrolling up
+    int lookahead() const;
+
+public slots:
+    void setViewport(QRect const& viewport);
+    // a dispatched load finished, successfully or not
+    void finished(int index);
+
+signals:
+    void dispatch(int index, QUrl const& url);
+    void lookaheadChanged(int pixels);
+
+private:
+    int  distance(int index) const;
+    void updateLookahead();
+    void resort();
+    void scheduleLater();
+    void schedule();
+
+    Geometry                 geometry_;
+    QRect                    viewport_;
+    QHash<int, QUrl>         pending_;
+    // by the time they were dispatched
+    QHash<int, qint64>       inFlight_;
+    // outdated loads in flight, and those of them enqueued again
+    QSet<int>                stale_;
+    QHash<int, QUrl>         again_;
+    QVector<QPair<int, int>> order_;    // distance, index
+    int                      cursor_;
+    int                      maxInFlight_;
+    int                      horizonFactor_;
+    bool                     backgroundFill_;
+    bool                     dirty_;
+    bool                     scheduled_;
+    QElapsedTimer            clock_;
+    qint64                   movedAt_;
+    // pixels per millisecond, and milliseconds of a load, both moving averages
+    double velocity_;
+    double latency_;
+    int    lookahead_;
+};
@@ -16,14 +16,30 @@
 #include "picdialog.hpp"
 
 #include <QApplication>
-#include <QImageReader>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileDialog>
+#include <QFontDatabase>
+#include <QFutureWatcher>
+#include <QMutexLocker>
 #include <QLabel>
 #include <QPixmap>
 #include <QScrollArea>
+#include <QScrollBar>
+#include <QShortcut>
+#include <QThread>
+#include <QTimer>
 #include <QUrl>
 
 #include "aspectratiopixmaplabel.hpp"
+#include "decodecache.hpp"
 #include "digikam_debug.h"
+#include "flowview.hpp"
+#include "loadpipeline.hpp"
+#include "loadscheduler.hpp"
+#include "profiler.hpp"
+#include "resampler.hpp"
+#include "thumbcache.hpp"
 
 #define INSERT_CANCEL_POINT                                               \
     do {                                                                  \
@@ -33,55 +49,136 @@
         }                                                                 \
     } while(0)
 
-#define POST_RESIZE_EVENT(obj) (qApp->postEvent(obj, new QResizeEvent(this->size(), this->size())))
+// milliseconds of a frame, and how much of it drain() may use
+constexpr int kFrameInterval = 16;
+constexpr int kDrainBudget   = 8;
 
-PicDialog::PicDialog(QWidget* parent)
+// If a picture big than 1920x1080, scale it for reduce the occpuation of mermory
+inline QImage reduced(QImage const& img) {
+    if((img.width() * img.height() > 1920 * 1080)) return Resampler::fitted(img, QSize(1920, 1080));
+    return img;
+}
+
+// digikam decodes with many threads by itself for some formats, so use half of the cores
+static int loaderCount() {
+    return qMax(QThread::idealThreadCount() / 2, 1);
+}
+
+// 8 bits DImg stores BGRA like QImage on little endian, so the QImage only borrows
+// the pixels, and keeps a reference of the DImg until the QImage is gone
+static QImage imageOf(DImg const& dimg) {
+    if(dimg.isNull()) return QImage();
+    if(dimg.sixteenBit() || QSysInfo::ByteOrder != QSysInfo::LittleEndian) return dimg.copyQImage();
+
+    auto*        owner  = new DImg(dimg);
+    uchar const* bits   = owner->bits();
+    auto         format = owner->hasAlpha() ? QImage::Format_ARGB32 : QImage::Format_RGB32;
+    // clang-format off
+    return QImage(bits, int(owner->width()), int(owner->height()), int(owner->width()) * 4, format
+                  , [](void* data) { delete static_cast<DImg*>(data); }
+                  , owner);
+    // clang-format on
+}
+
+
+PicDialog::PicDialog(QWidget* parent, bool virtualized, bool painted)
     : QDialog(parent)
     , stop_(false)
     , box_(new QWidget(this))
+    , area_(new QScrollArea(this))
     , layout_(new Z::FlowLayout(box_))
-    , pool_(nullptr)
-    , t_(nullptr) {
+    , pipeline_(nullptr)
+    , nextLoader_(0)
+    , view_(nullptr)
+    , scheduler_(nullptr)
+    , relayoutTimer_(new QTimer(this))
+    , cache_(nullptr)
+    , cacheSize_(0)
+    , readThreads_(0)
+    , decodeThreads_(0)
+    , pipelineDepth_(8)
+    , embeddedPreviews_(true)
+    , layoutPasses_(0)
+    , hud_(new QLabel(this))
+    , hudTimer_(new QTimer(this))
+    , loadByPool_(false) {
 
     this->setAttribute(Qt::WA_DeleteOnClose, true);
     this->installEventFilter(this);
     this->setLayout(new QHBoxLayout);
 
-    auto scrollWidget = new QScrollArea(this);
-    layout()->addWidget(scrollWidget);
-    scrollWidget->setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+    relayoutTimer_->setSingleShot(true);
+    relayoutTimer_->setInterval(kFrameInterval);
+    connect(relayoutTimer_, &QTimer::timeout, this, &PicDialog::relayout);
+
+    layout()->addWidget(area_);
 
-    scrollWidget->setWidget(box_);
+    hud_->hide();
+    hud_->move(12, 12);
+    hud_->setAttribute(Qt::WA_TransparentForMouseEvents);
+    hud_->setStyleSheet(QStringLiteral("background: rgba(0, 0, 0, 160); color: white; padding: 6px;"));
+    hud_->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+    hudTimer_->setInterval(500);
+    connect(hudTimer_, &QTimer::timeout, this, &PicDialog::updateHud);
+    connect(new QShortcut(Qt::Key_F12, this), &QShortcut::activated, this, &PicDialog::toggleHud);
+    connect(new QShortcut(QKeySequence::Save, this), &QShortcut::activated, this, &PicDialog::exportTrace);
+    area_->setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
 
     box_->setLayout(layout_);
 
-    // clang-format off
-    connect(this, &PicDialog::signalPixLoaded, this
-            , QOverload<QPixmap const&>::of(&PicDialog::add)
-            , Qt::BlockingQueuedConnection);
-    // clang-format on
+    scheduler_ = new LoadScheduler(
+        [this](int index) {
+            return this->tileRect(index);
+        },
+        this);
+    // load outside of the scheduler, loaders may process events
+    connect(scheduler_, &LoadScheduler::dispatch, this, &PicDialog::startLoad, Qt::QueuedConnection);
+    connect(area_->verticalScrollBar(), &QScrollBar::valueChanged, this, &PicDialog::updateViewport);
+
+    if(virtualized || painted) {
+        view_ = new FlowView(area_);
+        view_->setPainted(painted);
+        area_->setWidget(view_);
+        connect(view_, &FlowView::tileRequested, this, &PicDialog::loadTile);
+        connect(view_, &FlowView::tileReleased, this, &PicDialog::releaseTile);
+        // the band grows in the scroll direction, by what the loaders can catch up with
+        connect(scheduler_, &LoadScheduler::lookaheadChanged, view_, &FlowView::setLookahead);
+    } else {
+        area_->setWidget(box_);
+        // pictures far away are still loaded when nothing near is pending
+        scheduler_->setBackgroundFill(true);
+    }
 }
 
 PicDialog::~PicDialog() {
     this->stop_ = true;
-    if(t_) t_->stop();
-    if(pool_) pool_->waitForDone(1000);
-
-    if(t_) t_->wait();
+    delete pipeline_;
+    // the loaders call us on their threads, stop them before this is gone
+    for(auto* loader: loaders_) {
+        loader->disconnect(this);
+        loader->stopAllTasks();
+    }
+    for(auto* loader: loaders_) loader->wait();
+    // pictures decoded but not shown yet still serve the other dialogs, they load the rest themselves
+    for(auto const& result: results_)
+        if(result.final) finishClaim(result.index, result.img);
+    for(int index: claims_.keys()) finishClaim(index, QImage());
 }
 
 void PicDialog::setReferenceWidth(qreal width) {
+    if(view_) view_->setReferenceWidth(width);
     layout_->setRefWidth(width);
-    POST_RESIZE_EVENT(this);
+    scheduleRelayout();
 }
 
-qreal PicDialog::referenceWidth() {
+qreal PicDialog::referenceWidth() const {
     return layout_->refWidth();
 }
 
 void PicDialog::setSpacing(int spacing) {
+    if(view_) view_->setSpacing(spacing);
     layout_->setSpacing(spacing);
-    POST_RESIZE_EVENT(this);
+    scheduleRelayout();
 }
 
 int PicDialog::spacing() {
@@ -89,32 +186,157 @@ int PicDialog::spacing() {
 }
 
 void PicDialog::setStyle(Z::Style sty) {
+    if(view_) view_->setStyle(sty);
     layout_->setStyle(sty);
-    POST_RESIZE_EVENT(this);
+    scheduleRelayout();
+}
+
+void PicDialog::setOverscan(int overscan) {
+    if(view_) view_->setOverscan(overscan);
+}
+
+void PicDialog::setDiskCacheSize(int mb) {
+    cacheSize_ = mb;
+    if(cache_) cache_->setCapacity(mb);
+}
+
+void PicDialog::setReadThreads(int count) {
+    readThreads_ = count;
+    if(pipeline_) pipeline_->setReadThreads(count);
+}
+
+void PicDialog::setDecodeThreads(int count) {
+    decodeThreads_ = count;
+    if(pipeline_) pipeline_->setDecodeThreads(count);
+}
+
+void PicDialog::setPipelineDepth(int depth) {
+    pipelineDepth_ = depth;
+    if(pipeline_) pipeline_->setDepth(depth);
+}
+
+void PicDialog::setEmbeddedPreviews(bool enable) {
+    embeddedPreviews_ = enable;
+    if(pipeline_) pipeline_->setEmbeddedPreviews(enable);
+}
+
+void PicDialog::setDecodeCache(QSharedPointer<DecodeCache> cache) {
+    decodeCache_ = cache;
+}
+
+void PicDialog::updateTile(int index, TileInfo const& info) {
+    INSERT_CANCEL_POINT;
+    if(index < 0 || index >= tiles_.count()) return;
+    tiles_[index] = info;
+    // a load in flight still has the old stamps, the tile is loaded again after it
+    scheduler_->invalidate(index);
+    if(decodeCache_) decodeCache_->forget(info.url);
+    if(view_) return view_->setTileSize(index, info.size);
+
+    labels_.at(index)->setSourceSize(info.size);
+    scheduleRelayout();
+    loadTile(index, info.url);
+}
+
+int PicDialog::layoutPasses() const {
+    return view_ ? view_->layoutPasses() : layoutPasses_;
 }
 
 void PicDialog::add(LoadingDescription const& desc, DImg const& dimg) {
-    qApp->processEvents();
     if(dimg.isNull()) {
         qCDebug(DIGIKAM_DPLUGIN_GENERIC_LOG) << "DImg " << desc.filePath << " load failed";
         return;
     }
     INSERT_CANCEL_POINT;
-    QPixmap img = dimg.convertToPixmap();
-    INSERT_CANCEL_POINT;
-    if((img.width() * img.height() > 1920 * 1080))
-        img = img.scaled(1920, 1080, Qt::KeepAspectRatio, Qt::SmoothTransformation);
-    this->add(img);
+    this->add(-1, reduced(imageOf(dimg)));
 }
 
 void PicDialog::add(const QPixmap& pix) {
-    qApp->processEvents();
-    if(pix.isNull()) return;
+    this->add(-1, pix.toImage());
+}
+
+void PicDialog::add(int index, QImage const& img, bool final) {
     INSERT_CANCEL_POINT;
-    auto* lbl = new AspectRatioPixmapLabel;
-    lbl->setPixmap(pix);
-    layout_->addWidget(lbl);
-    POST_RESIZE_EVENT(this);
+    if(!final) {
+        if(view_) return view_->setTilePreview(index, img);
+        if(index >= 0 && index < labels_.count()) labels_.at(index)->setPreview(img);
+        return;
+    }
+    if(index < 0) {
+        if(img.isNull()) return;
+        auto* lbl = new AspectRatioPixmapLabel;
+        lbl->setImage(img);
+        layout_->addWidget(lbl);
+        scheduleRelayout();
+        return;
+    }
+    finishClaim(index, img);
+    scheduler_->finished(index);
+    if(!img.isNull()) emit tileLoaded(index);
+    if(view_) return view_->setTileImage(index, img);
+    if(index >= labels_.count() || img.isNull()) return;
+
+    // the placeholder already has the right shape, only relayout if its size was unknown
+    auto* lbl     = labels_.at(index);
+    bool  unknown = lbl->sizeHint().isEmpty();
+    lbl->setImage(img);
+    if(unknown) scheduleRelayout();
+}
+
+// Workers never wait for the GUI, they only append to the queue and wake drain() once
+void PicDialog::push(int index, QImage const& img, bool final) {
+    QMutexLocker locker(&resultsMutex_);
+    bool         wake = results_.isEmpty();
+    results_.append(Result { index, img, final });
+    if(wake) QMetaObject::invokeMethod(this, "drain", Qt::QueuedConnection);
+}
+
+void PicDialog::imageLoaded(LoadingDescription const& desc, DImg const& dimg) {
+    int              edge = desc.previewParameters.size;
+    QVector<Request> requests;
+    {
+        QMutexLocker locker(&requestsMutex_);
+        requests = requests_.take(qMakePair(desc.filePath, edge));
+    }
+    INSERT_CANCEL_POINT;
+    if(dimg.isNull()) qCDebug(DIGIKAM_DPLUGIN_GENERIC_LOG) << "DImg " << desc.filePath << " load failed";
+
+    auto*  profiler = Profiler::instance();
+    qint64 start    = profiler->now();
+    QImage img      = Resampler::fitted(imageOf(dimg), QSize(edge, edge));
+    if(!img.isNull()) cache_->setColor(desc.filePath, Resampler::average(img));
+    for(auto& request: requests) {
+        profiler->record("decode", request.start, start, request.index);
+        profiler->record("convert", start, profiler->now(), request.index);
+        // a failed load still lets the scheduler know it is finished
+        this->push(request.index, img);
+    }
+}
+
+// Insert as many loaded pictures as the frame budget allows, the rest waits for the next frame
+void PicDialog::drain() {
+    QElapsedTimer timer;
+    timer.start();
+
+    QVector<Result> batch;
+    {
+        QMutexLocker locker(&resultsMutex_);
+        batch.swap(results_);
+    }
+
+    int i = 0;
+    for(; i < batch.count() && timer.elapsed() < kDrainBudget; ++i) {
+        auto&           result = batch.at(i);
+        Profiler::Scope scope("insert", result.index);
+        this->add(result.index, result.img, result.final);
+    }
+    if(i == batch.count()) return;
+
+    {
+        QMutexLocker locker(&resultsMutex_);
+        results_ = batch.mid(i) + results_;
+    }
+    QTimer::singleShot(kFrameInterval, this, &PicDialog::drain);
 }
 
 // Update layout after the size of dialog has changed
@@ -123,53 +345,225 @@ bool PicDialog::eventFilter(QObject* watched, QEvent* event) {
     auto dialog = qobject_cast<PicDialog*>(watched);
     if(!dialog) return false;
 
+    scheduleRelayout();
+    return true;
+}
+
+// Resizes and added tiles within one frame share a single relayout
+void PicDialog::scheduleRelayout() {
+    if(!relayoutTimer_->isActive()) relayoutTimer_->start();
+}
+
+void PicDialog::relayout() {
+    Profiler::Scope scope("relayout");
+    ++layoutPasses_;
     for(int i = 0; i < layout_->count(); ++i) {
         auto lbl = qobject_cast<AspectRatioPixmapLabel*>(layout_->itemAt(i)->widget());
         if(!lbl) continue;
         lbl->adjust();
     }
-    box_->resize(dialog->width(), layout_->innerHeight());
-    return true;
+    box_->resize(this->width(), layout_->innerHeight());
+    updateViewport();
+}
+
+void PicDialog::toggleHud() {
+    hud_->setVisible(!hud_->isVisible());
+    if(!hud_->isVisible()) return hudTimer_->stop();
+    hud_->raise();
+    updateHud();
+    hudTimer_->start();
+}
+
+void PicDialog::updateHud() {
+    auto*   profiler = Profiler::instance();
+    QString text     = profiler->enabled() ? profiler->summary() : tr("Enable \"Record timings\" in Configure");
+    text += tr("\ntiles %1  pending %2  layout passes %3  (Ctrl+S exports a trace)")
+                .arg(tiles_.count())
+                .arg(scheduler_->pending())
+                .arg(layoutPasses());
+    if(decodeCache_) {
+        auto stats = decodeCache_->stats();
+        text += tr("\nshared decodes: %1 decoded  %2 cached  %3 joined")
+                    .arg(stats.decodes)
+                    .arg(stats.hits)
+                    .arg(stats.joins);
+    }
+    hud_->setText(text);
+    hud_->adjustSize();
+}
+
+void PicDialog::exportTrace() {
+    QString path = QFileDialog::getSaveFileName(this, tr("Export trace"), QDir::home().filePath("flowview-trace.json"),
+                                                tr("Chrome trace (*.json)"));
+    if(path.isEmpty()) return;
+    if(!Profiler::instance()->exportTrace(path))
+        qCDebug(DIGIKAM_DPLUGIN_GENERIC_LOG) << "Export trace to " << path << " failed";
+}
+
+QRect PicDialog::tileRect(int index) const {
+    if(view_) return view_->tileRect(index);
+    if(index < 0 || index >= labels_.count()) return QRect();
+    return labels_.at(index)->geometry();
+}
+
+// The longest edge a picture needs to be decoded at to cover its tile on screen,
+// decoded pictures are bounded by a level so a bit of resizing reuses the same decode
+int PicDialog::decodeEdge(int index) const {
+    QSize tile = tileRect(index).size();
+    if(tile.isEmpty()) tile = QSize(qRound(referenceWidth()), qRound(referenceWidth()));
+    return TileInfo::levelFor(tiles_.value(index).size, tile, devicePixelRatioF());
+}
+
+QRect PicDialog::viewport() const {
+    return QRect(0, area_->verticalScrollBar()->value(), area_->viewport()->width(), area_->viewport()->height());
+}
+
+void PicDialog::updateViewport() {
+    QRect rect = viewport();
+    scheduler_->setViewport(rect);
+    // virtualized view touches its own tiles
+    if(view_) return;
+    for(auto* lbl: labels_)
+        if(lbl->geometry().intersects(rect)) lbl->touch();
 }
 
 void PicDialog::load(const QUrl& url, bool loadByPool) {
+    this->load(TileInfo::fromHeader(url), loadByPool);
+}
+
+void PicDialog::load(TileInfo const& info, bool loadByPool) {
+    INSERT_CANCEL_POINT;
+    Profiler::Scope scope("place", tiles_.count());
+    loadByPool_ = loadByPool;
+    // keep every thread busy, and a few requests queued behind them
+    scheduler_->setMaxInFlight(loadByPool ? (pipeline_ ? pipeline_->capacity() : QThread::idealThreadCount() * 2)
+                                          : loaderCount() * 2);
+    int index = addTile(info);
+    // virtualized view loads pixels when the tile become visible
+    if(view_) return;
+    // the scheduler dispatches after all placeholders are placed
+    loadTile(index, info.url);
+}
+
+int PicDialog::addTile(TileInfo const& info) {
+    tiles_.append(info);
+    QRgb color = thumbCache()->color(info.url.toLocalFile());
+    if(view_) return view_->append(info.url, info.size, color);
+
+    auto* lbl = new AspectRatioPixmapLabel;
+    lbl->setSourceSize(info.size);
+    lbl->setPlaceholder(color);
+    lbl->setIndex(labels_.count());
+    lbl->setUrl(info.url);
+    // the label grew over its level, load a bigger one
+    connect(lbl, &AspectRatioPixmapLabel::levelRequested, this, [this, url = info.url](int index) {
+        this->loadTile(index, url);
+    });
+    layout_->addWidget(lbl);
+    labels_.append(lbl);
+    scheduleRelayout();
+    return labels_.count() - 1;
+}
+
+void PicDialog::loadTile(int index, const QUrl& url) {
+    INSERT_CANCEL_POINT;
+    if(Profiler::instance()->enabled()) queuedAt_.insert(index, Profiler::instance()->now());
+    scheduler_->enqueue(index, url);
+}
+
+// The tile left the band around the viewport, its load is dropped unless it started already
+void PicDialog::releaseTile(int index) {
+    scheduler_->cancel(index);
+    if(!pipeline_ || !pipeline_->cancel(index)) return;
+    // the other dialogs waiting for this decode load the picture themselves
+    finishClaim(index, QImage());
+    scheduler_->finished(index);
+}
+
+void PicDialog::startLoad(int index, const QUrl& url) {
     INSERT_CANCEL_POINT;
     qCDebug(DIGIKAM_DPLUGIN_GENERIC_LOG) << "Load image: " << url.toLocalFile();
-    if(!loadByPool) {
-        if(!t_) {
-            static PreviewLoadThread t;
-            t_ = &t;
-            // clang-format off
-            connect(t_, &PreviewLoadThread::signalImageLoaded, this
-                    , QOverload<LoadingDescription const&
-                    , DImg const&>::of(&PicDialog::add)
-                    , Qt::QueuedConnection);
-            // clang-format on
+    qint64 queued = queuedAt_.value(index, -1);
+    int    edge   = decodeEdge(index);
+    queuedAt_.remove(index);
+    if(!claim(index, edge)) return;
+    if(!loadByPool_) {
+        if(loaders_.isEmpty()) {
+            // every loader decodes one picture at a time, so several of them use more cores
+            for(int i = 0; i < loaderCount(); ++i) {
+                auto* loader = new PreviewLoadThread(this);
+                // keep every request, the default drops the older ones
+                loader->setLoadingPolicy(ManagedLoadSaveThread::LoadingPolicyAppend);
+                connect(loader, &PreviewLoadThread::signalImageLoaded, this, &PicDialog::imageLoaded,
+                        Qt::DirectConnection);
+                loaders_.append(loader);
+            }
+        }
+        auto*   profiler = Profiler::instance();
+        QString path     = url.toLocalFile();
+        profiler->record("wait", queued, profiler->now(), index);
+        {
+            QMutexLocker locker(&requestsMutex_);
+            requests_[qMakePair(path, edge)].append(Request { index, profiler->now() });
         }
-        // t_->load(url.toLocalFile(), PreviewSettings::fastPreview(), 1920);
-        const DImg& dimg = t_->loadFastSynchronously(url.toLocalFile(), 1920);
-        this->add(LoadingDescription(url.toLocalFile()), dimg);
+        // digikam loads a preview bounded by the edge, from its cache if it is there
+        loaders_.at(nextLoader_++ % loaders_.count())->load(path, PreviewSettings::fastPreview(), edge);
         return;
     }
-    // load by QThreadPool
-    if(!pool_) {
-        static QThreadPool pool;
-        pool_ = &pool;
-    }
-    auto task = [this](QUrl const& url) {
-        INSERT_CANCEL_POINT;
-        QImageReader imgReader(url.toLocalFile());
-        imgReader.setAutoTransform(true);
-        QPixmap pix = QPixmap::fromImage(imgReader.read());
-        if(pix.isNull()) {
-            qCDebug(DIGIKAM_DPLUGIN_GENERIC_LOG) << "Image " << url.toLocalFile() << " load failed";
-            return;
-        }
-        INSERT_CANCEL_POINT;
-        if((pix.width() * pix.height() > 1920 * 1080))
-            pix = pix.scaled(1920, 1080, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    // load by the staged pipeline
+    if(!pipeline_) {
+        pipeline_ = new LoadPipeline(thumbCache(), [this](int index, QImage const& img, bool final) {
+            this->push(index, img, final);
+        });
+        pipeline_->setReadThreads(readThreads_);
+        pipeline_->setDecodeThreads(decodeThreads_);
+        pipeline_->setDepth(pipelineDepth_);
+        pipeline_->setEmbeddedPreviews(embeddedPreviews_);
+    }
+    pipeline_->enqueue(index, tiles_.value(index), edge, queued);
+    // the pipeline adapts its threads, let the scheduler follow
+    scheduler_->setMaxInFlight(pipeline_->capacity());
+}
 
-        emit this->signalPixLoaded(pix);
-    };
-    pool_->start(std::bind(task, url));
+bool PicDialog::claim(int index, int edge) {
+    if(!decodeCache_) return true;
+    TileInfo        info    = tiles_.value(index);
+    bool            claimed = false;
+    QFuture<QImage> future  = decodeCache_->request(info, edge, &claimed);
+    // the scheduler never dispatches a tile twice, so it has one claim at most
+    if(claimed) {
+        claims_.insert(index, Claim { info, edge });
+        return true;
+    }
+    if(future.isFinished()) {
+        this->push(index, future.result());
+        return false;
+    }
+
+    auto watcher = new QFutureWatcher<QImage>(this);
+    connect(watcher, &QFutureWatcher<QImage>::finished, this, [this, watcher, index, url = info.url]() {
+        QImage img = watcher->result();
+        watcher->deleteLater();
+        // the other dialog dropped the decode
+        if(img.isNull()) return this->startLoad(index, url);
+        this->push(index, img);
+    });
+    watcher->setFuture(future);
+    return false;
+}
+
+void PicDialog::finishClaim(int index, QImage const& img) {
+    auto it = claims_.find(index);
+    if(it == claims_.end()) return;
+    decodeCache_->finish(it->info, it->edge, img);
+    claims_.erase(it);
+}
+
+ThumbCache* PicDialog::thumbCache() {
+    if(!cache_) {
+        static ThumbCache cache;
+        cache_ = &cache;
+        cache_->setCapacity(cacheSize_);
+    }
+    return cache_;
 }
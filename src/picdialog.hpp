@@ -15,41 +15,156 @@
 
 #include "flowlayout.h"
 #include <QDialog>
-#include <QThreadPool>
+#include <QHash>
+#include <QMutex>
+#include <QSharedPointer>
 
 #include "previewloadthread.h"
+#include "tileinfo.hpp"
 
 using namespace Digikam;
 
+class AspectRatioPixmapLabel;
+class DecodeCache;
+class FlowView;
+class LoadPipeline;
+class LoadScheduler;
+class QLabel;
+class QScrollArea;
+class QTimer;
+class ThumbCache;
+
 class PicDialog : public QDialog {
     Q_OBJECT;
 
 public:
-    PicDialog(QWidget* parent = nullptr);
+    // virtualized dialog only create widgets for visible pictures,
+    // painted dialog is virtualized and paints all of them in one widget
+    PicDialog(QWidget* parent = nullptr, bool virtualized = false, bool painted = false);
     ~PicDialog();
 
     void  setReferenceWidth(qreal width);
-    qreal referenceWidth();
+    qreal referenceWidth() const;
     void  setSpacing(int spacing);
     int   spacing();
 
     bool eventFilter(QObject* watched, QEvent* event) override;
 
     void load(QUrl const& url, bool loadbyPool = false);
+    // place the tile from info first, the pixels are streamed in later
+    void load(TileInfo const& info, bool loadbyPool = false);
     void setStyle(Z::Style);
+    void setOverscan(int overscan);
+    // capacity of the on-disk cache used by custom loader, in MB
+    void setDiskCacheSize(int mb);
+    // threads and queue depth of custom loader, 0 threads means automatic
+    void setReadThreads(int count);
+    void setDecodeThreads(int count);
+    void setPipelineDepth(int depth);
+    // custom loader decodes the preview embedded in RAW and big JPEG files when it is big enough,
+    // digikam loader always does with its fast preview
+    void setEmbeddedPreviews(bool enable);
+    // pictures decoded by all dialogs, a picture another dialog decodes is not decoded again
+    void setDecodeCache(QSharedPointer<DecodeCache> cache);
+    // the picture of a tile changed on disk, place and load it again
+    void updateTile(int index, TileInfo const& info);
+    // how many times the tiles were laid out, for benchmarks
+    int layoutPasses() const;
 
 public slots:
     // add picture to layout
     void add(LoadingDescription const& desc, DImg const& img);
     void add(const QPixmap&);
+    // img is shared with the label, it is never copied on the way,
+    // a picture which is not final only shows until the final one arrives
+    void add(int index, QImage const& img, bool final = true);
 
 signals:
-    void signalPixLoaded(QPixmap const&);
+    // the picture of a tile was shown
+    void tileLoaded(int index);
+
+protected slots:
+    void drain();
+    void relayout();
+    // timings of Profiler over the pictures, F12 toggles it
+    void toggleHud();
+    void updateHud();
+    void exportTrace();
+
+protected:
+    // thread safe, called by the loader threads
+    void push(int index, QImage const& img, bool final = true);
+    // runs on the digikam loader threads
+    void imageLoaded(LoadingDescription const& desc, DImg const& img);
+    int  addTile(TileInfo const& info);
+    void loadTile(int index, QUrl const& url);
+    // the view dropped the tile, a load not started yet is dropped too
+    void releaseTile(int index);
+    void startLoad(int index, QUrl const& url);
+    // false when the decode cache has the picture or another dialog decodes it, it comes from there
+    bool claim(int index, int edge);
+    // hand the picture of a claimed tile to the waiting dialogs, null makes them load it
+    void finishClaim(int index, QImage const& img);
+    // geometry of a tile and the visible area, both in the coordinate of the scroll widget
+    QRect tileRect(int index) const;
+    int   decodeEdge(int index) const;
+    QRect viewport() const;
+    void  updateViewport();
+    void  scheduleRelayout();
+    // the shared disk cache, it also keeps the placeholder colors
+    ThumbCache* thumbCache();
 
 private:
     QAtomicInt         stop_;
     QWidget*           box_;
+    QScrollArea*       area_;
     Z::FlowLayout*     layout_;
-    QThreadPool*       pool_;
-    PreviewLoadThread* t_;
+    LoadPipeline*      pipeline_;
+    int                nextLoader_;
+    FlowView*          view_;
+    LoadScheduler*     scheduler_;
+    QTimer*            relayoutTimer_;
+    ThumbCache*        cache_;
+    int                cacheSize_;
+    int                readThreads_;
+    int                decodeThreads_;
+    int                pipelineDepth_;
+    bool               embeddedPreviews_;
+    int                layoutPasses_;
+    QLabel*            hud_;
+    QTimer*            hudTimer_;
+    bool               loadByPool_;
+    QVector<TileInfo>  tiles_;
+    // when a tile was handed to the scheduler, for the queue wait of Profiler
+    QHash<int, qint64> queuedAt_;
+    QMutex             resultsMutex_;
+
+    struct Result {
+        int    index;
+        QImage img;
+        bool   final;
+    };
+    // loaded pictures waiting for drain()
+    QVector<Result> results_;
+
+    // a tile waiting for digikam, start is for Profiler
+    struct Request {
+        int    index;
+        qint64 start;
+    };
+    // owned digikam loaders, they share digikam's preview cache
+    QVector<PreviewLoadThread*> loaders_;
+    QMutex                      requestsMutex_;
+    // by path and decode edge
+    QHash<QPair<QString, int>, QVector<Request>> requests_;
+
+    // a decode this dialog claimed in the decode cache
+    struct Claim {
+        TileInfo info;
+        int      edge;
+    };
+    QSharedPointer<DecodeCache> decodeCache_;
+    QHash<int, Claim>           claims_;
+    // placeholders of the non-virtualized view, in album order
+    QVector<AspectRatioPixmapLabel*> labels_;
 };
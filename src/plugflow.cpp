@@ -19,15 +19,35 @@
 
 #include "digikam_debug.h"
 
+#include "albumindex.hpp"
+#include "decodecache.hpp"
 #include "picdialog.hpp"
 #include "plugflow.hpp"
 #include "plugsettings.hpp"
+#include "profiler.hpp"
+#include "tilebudget.hpp"
 
 namespace Cathaysia {
 
-FlowPlugin::FlowPlugin(QObject* const parent) : DPluginGeneric(parent), iface_(nullptr), settings_(nullptr) {
+FlowPlugin::FlowPlugin(QObject* const parent)
+    : DPluginGeneric(parent)
+    , iface_(nullptr)
+    , settings_(nullptr)
+    , decodeCache_(new DecodeCache) {
     settings_ = new PlugSettings(nullptr);
     settings_->setPlugin(this);
+
+    // the budget is shared by all flow views, the decode cache gets its share
+    TileBudget::instance()->setBudget(settings_->memoryBudget());
+    decodeCache_->setCapacity(TileBudget::instance()->cacheBudget());
+    connect(settings_, &PlugSettings::memoryBudgetChanged, this, [this](int mb) {
+        TileBudget::instance()->setBudget(mb);
+        decodeCache_->setCapacity(TileBudget::instance()->cacheBudget());
+    });
+    Profiler::instance()->setEnabled(settings_->recordTimings());
+    connect(settings_, &PlugSettings::recordTimingsChanged, this, [](bool record) {
+        Profiler::instance()->setEnabled(record);
+    });
 }
 
 FlowPlugin::~FlowPlugin() noexcept {
@@ -87,21 +107,45 @@ void FlowPlugin::setup(QObject* const parent) {
 }
 
 void FlowPlugin::flowView() {
-    auto* dialog = new PicDialog;
+    auto* dialog = new PicDialog(nullptr, settings_->virtualized(), settings_->painted());
     dialog->setSpacing(settings_->spacing());
     dialog->setReferenceWidth(settings_->referenceWidth());
     dialog->setStyle(settings_->style());
+    dialog->setOverscan(settings_->overscan());
+    dialog->setDiskCacheSize(settings_->diskCacheSize());
+    dialog->setReadThreads(settings_->readThreads());
+    dialog->setDecodeThreads(settings_->decodeThreads());
+    dialog->setPipelineDepth(settings_->pipelineDepth());
+    dialog->setEmbeddedPreviews(settings_->embeddedPreviews());
+    // the same pictures opened twice, or in two albums, are decoded once
+    dialog->setDecodeCache(decodeCache_);
 
     connect(settings_, &PlugSettings::signalStyleChanged, dialog, &PicDialog::setStyle);
     connect(settings_, &PlugSettings::spacingChanged, dialog, &PicDialog::setSpacing);
     connect(settings_, &PlugSettings::refWidthChanged, dialog, &PicDialog::setReferenceWidth);
+    connect(settings_, &PlugSettings::overscanChanged, dialog, &PicDialog::setOverscan);
+    connect(settings_, &PlugSettings::diskCacheSizeChanged, dialog, &PicDialog::setDiskCacheSize);
+    connect(settings_, &PlugSettings::readThreadsChanged, dialog, &PicDialog::setReadThreads);
+    connect(settings_, &PlugSettings::decodeThreadsChanged, dialog, &PicDialog::setDecodeThreads);
+    connect(settings_, &PlugSettings::pipelineDepthChanged, dialog, &PicDialog::setPipelineDepth);
+    connect(settings_, &PlugSettings::embeddedPreviewsChanged, dialog, &PicDialog::setEmbeddedPreviews);
 
     dialog->resize(800, 600);
     dialog->show();
 
     auto items = iface_->currentAlbumItems();
     qCDebug(DIGIKAM_DPLUGIN_GENERIC_LOG) << "These images will be loaded: " << items;
-    for(auto& it: items) dialog->load(it, settings_->useCustomLoader());
+    // place every tile first, pixels come later without moving any tile. The tiles seen
+    // before come from the index of the album, the others from the database
+    auto* index = new AlbumIndex(AlbumIndex::keyOf(iface_->currentAlbums()), dialog);
+    connect(index, &AlbumIndex::changed, dialog, &PicDialog::updateTile);
+    for(auto& it: items) {
+        TileInfo info;
+        if(!index->find(it, info)) info = TileInfo::fromInfoMap(it, iface_->itemInfo(it));
+        index->append(info);
+        dialog->load(info, settings_->useCustomLoader());
+    }
+    index->reconcile();
 }
 
 }    // namespace Cathaysia
@@ -15,6 +15,8 @@
 
 #pragma once
 
+#include <QSharedPointer>
+
 #include "dplugingeneric.h"
 #include "flowlayout.h"
 
@@ -22,6 +24,8 @@
 
 using namespace Digikam;
 
+class DecodeCache;
+
 namespace Cathaysia {
 
 class PlugSettings;
@@ -47,8 +51,10 @@ protected:
     void flowView();
 
 private:
-    Digikam::DInfoInterface* iface_;
-    PlugSettings*            settings_;
+    Digikam::DInfoInterface*    iface_;
+    PlugSettings*               settings_;
+    // every dialog keeps a reference, so it outlives the plugin while one is open
+    QSharedPointer<DecodeCache> decodeCache_;
 };
 
 }    // namespace Cathaysia
@@ -15,6 +15,7 @@
 #include "plugsettings.hpp"
 
 #include <QApplication>
+#include <QCheckBox>
 #include <QComboBox>
 #include <QDebug>
 #include <QDialogButtonBox>
@@ -37,10 +38,20 @@ QWidget* ARRANGE_WIDGET(const QString& lblText, QWidget* widget, QWidget* parent
 
 namespace Cathaysia {
 
-QComboBox* styleBox    = nullptr;
-QComboBox* loaderBox   = nullptr;
-QSpinBox*  spacingSpin = nullptr;
-QSpinBox*  refSpin     = nullptr;
+QComboBox* styleBox     = nullptr;
+QComboBox* loaderBox    = nullptr;
+QSpinBox*  spacingSpin  = nullptr;
+QSpinBox*  refSpin      = nullptr;
+QCheckBox* virtualBox   = nullptr;
+QSpinBox*  overscanSpin = nullptr;
+QCheckBox* paintedBox   = nullptr;
+QSpinBox*  cacheSpin    = nullptr;
+QSpinBox*  budgetSpin   = nullptr;
+QCheckBox* timingsBox   = nullptr;
+QSpinBox*  readSpin     = nullptr;
+QSpinBox*  decodeSpin   = nullptr;
+QSpinBox*  depthSpin    = nullptr;
+QCheckBox* previewBox   = nullptr;
 
 inline const QString strLoaderCustom() {
     return QObject::tr("Custom Loader");
@@ -65,6 +76,14 @@ PlugSettings::PlugSettings(QWidget* const parent)
     layout()->addWidget(getSpacingOption());
     layout()->addWidget(getRefWidthOption());
     layout()->addWidget(getLoaderOption());
+    layout()->addWidget(getVirtualizedOption());
+    layout()->addWidget(getOverscanOption());
+    layout()->addWidget(getPaintedOption());
+    layout()->addWidget(getDiskCacheOption());
+    layout()->addWidget(getMemoryBudgetOption());
+    layout()->addWidget(getEmbeddedPreviewsOption());
+    layout()->addWidget(getPipelineOption());
+    layout()->addWidget(getRecordTimingsOption());
     layout()->addWidget(m_buttons);
     resize(layout()->sizeHint());
 
@@ -80,10 +99,28 @@ void PlugSettings::accept() {
     settings_->setValue("style", styleBox->currentText());
     settings_->setValue("useCustomLoader", useCustomLoader_);
     settings_->setValue("refWidth", refSpin->value());
+    settings_->setValue("virtualized", virtualBox->isChecked());
+    settings_->setValue("overscan", overscanSpin->value());
+    settings_->setValue("painted", paintedBox->isChecked());
+    settings_->setValue("diskCacheSize", cacheSpin->value());
+    settings_->setValue("memoryBudget", budgetSpin->value());
+    settings_->setValue("recordTimings", timingsBox->isChecked());
+    settings_->setValue("readThreads", readSpin->value());
+    settings_->setValue("decodeThreads", decodeSpin->value());
+    settings_->setValue("pipelineDepth", depthSpin->value());
+    settings_->setValue("embeddedPreviews", previewBox->isChecked());
 
     emit spacingChanged(spacing());
     emit signalStyleChanged(style());
     emit refWidthChanged(referenceWidth());
+    emit overscanChanged(overscan());
+    emit diskCacheSizeChanged(diskCacheSize());
+    emit memoryBudgetChanged(memoryBudget());
+    emit recordTimingsChanged(recordTimings());
+    emit readThreadsChanged(readThreads());
+    emit decodeThreadsChanged(decodeThreads());
+    emit pipelineDepthChanged(pipelineDepth());
+    emit embeddedPreviewsChanged(embeddedPreviews());
     QDialog::accept();
 }
 
@@ -102,10 +139,28 @@ void PlugSettings::reject() {
 
     spacingSpin->setValue(spacing());
     refSpin->setValue(referenceWidth());
+    virtualBox->setChecked(virtualized());
+    overscanSpin->setValue(overscan());
+    paintedBox->setChecked(painted());
+    cacheSpin->setValue(diskCacheSize());
+    budgetSpin->setValue(memoryBudget());
+    timingsBox->setChecked(recordTimings());
+    readSpin->setValue(readThreads());
+    decodeSpin->setValue(decodeThreads());
+    depthSpin->setValue(pipelineDepth());
+    previewBox->setChecked(embeddedPreviews());
 
     emit spacingChanged(spacing());
     emit signalStyleChanged(style());
     emit refWidthChanged(referenceWidth());
+    emit overscanChanged(overscan());
+    emit diskCacheSizeChanged(diskCacheSize());
+    emit memoryBudgetChanged(memoryBudget());
+    emit recordTimingsChanged(recordTimings());
+    emit readThreadsChanged(readThreads());
+    emit decodeThreadsChanged(decodeThreads());
+    emit pipelineDepthChanged(pipelineDepth());
+    emit embeddedPreviewsChanged(embeddedPreviews());
     QDialog::reject();
 }
 
@@ -174,6 +229,119 @@ QWidget* PlugSettings::getRefWidthOption() {
 
     return ARRANGE_WIDGET(tr("Reference widget"), refSpin, this);
 }
+
+QWidget* PlugSettings::getVirtualizedOption() {
+    virtualBox = new QCheckBox(this);
+    virtualBox->setChecked(virtualized());
+    virtualBox->setWhatsThis(
+        tr("Only create widgets for the pictures near the visible area, "
+           "memory will not grow with the size of album. Take effect on next open."));
+
+    return ARRANGE_WIDGET(tr("Virtualized view"), virtualBox, this);
+}
+
+QWidget* PlugSettings::getOverscanOption() {
+    overscanSpin = new QSpinBox(this);
+    overscanSpin->setMinimum(0);
+    overscanSpin->setMaximum(INT_MAX);
+    overscanSpin->setSuffix(tr(" px"));
+    overscanSpin->setValue(overscan());
+    overscanSpin->setWhatsThis(tr("Pixels above and below the visible area which are loaded in virtualized view."));
+    connect(overscanSpin, QOverload<int>::of(&QSpinBox::valueChanged), [this](int i) {
+        emit this->overscanChanged(i);
+    });
+
+    return ARRANGE_WIDGET(tr("Overscan"), overscanSpin, this);
+}
+
+QWidget* PlugSettings::getPaintedOption() {
+    paintedBox = new QCheckBox(this);
+    paintedBox->setChecked(painted());
+    paintedBox->setWhatsThis(
+        tr("Paint all pictures in one widget instead of a widget per picture, scrolling stays smooth "
+           "without a GPU. Implies virtualized view. Take effect on next open."));
+
+    return ARRANGE_WIDGET(tr("Painted view"), paintedBox, this);
+}
+
+QWidget* PlugSettings::getDiskCacheOption() {
+    cacheSpin = new QSpinBox(this);
+    cacheSpin->setMinimum(0);
+    cacheSpin->setMaximum(INT_MAX);
+    cacheSpin->setSuffix(tr(" MB"));
+    cacheSpin->setValue(diskCacheSize());
+    cacheSpin->setWhatsThis(
+        tr("Custom Loader keeps reduced pictures on disk, so opening the same album again "
+           "does not decode them again. 0 disables the cache."));
+
+    return ARRANGE_WIDGET(tr("Disk cache"), cacheSpin, this);
+}
+
+QWidget* PlugSettings::getMemoryBudgetOption() {
+    budgetSpin = new QSpinBox(this);
+    budgetSpin->setMinimum(0);
+    budgetSpin->setMaximum(INT_MAX);
+    budgetSpin->setSuffix(tr(" MB"));
+    budgetSpin->setValue(memoryBudget());
+    budgetSpin->setWhatsThis(
+        tr("Memory used by the pictures of all flow views. A quarter of it keeps decoded pictures shared "
+           "by the views and another quarter the tiles of the full screen view, at least 64 MB each. When "
+           "the rest is exceeded, pictures not seen for the longest time are dropped and loaded again when "
+           "visible. 0 means no limit, the shared pictures and the full screen view then keep 256 MB each."));
+
+    return ARRANGE_WIDGET(tr("Memory budget"), budgetSpin, this);
+}
+
+QWidget* PlugSettings::getEmbeddedPreviewsOption() {
+    previewBox = new QCheckBox(this);
+    previewBox->setChecked(embeddedPreviews());
+    previewBox->setWhatsThis(
+        tr("Custom Loader shows the preview embedded in RAW and big JPEG files when it is big enough for "
+           "the tile, instead of decoding the whole picture. The full screen view always decodes the picture."));
+
+    return ARRANGE_WIDGET(tr("Embedded previews"), previewBox, this);
+}
+
+// Custom Loader reads, decodes and scales in separate stages
+QWidget* PlugSettings::getPipelineOption() {
+    readSpin = new QSpinBox(this);
+    readSpin->setRange(0, 16);
+    readSpin->setSpecialValueText(tr("Automatic"));
+    readSpin->setValue(readThreads());
+    readSpin->setWhatsThis(
+        tr("Threads reading files for Custom Loader. Automatic adds threads while the disk or network is "
+           "slower than decoding."));
+
+    decodeSpin = new QSpinBox(this);
+    decodeSpin->setRange(0, 256);
+    decodeSpin->setSpecialValueText(tr("Automatic"));
+    decodeSpin->setValue(decodeThreads());
+    decodeSpin->setWhatsThis(tr("Threads decoding pictures for Custom Loader. Automatic uses every core."));
+
+    depthSpin = new QSpinBox(this);
+    depthSpin->setRange(1, 256);
+    depthSpin->setValue(pipelineDepth());
+    depthSpin->setWhatsThis(
+        tr("Pictures read or decoded ahead of the next stage of Custom Loader. More uses more memory."));
+
+    auto w = new QWidget(this);
+    w->setLayout(new QVBoxLayout);
+    w->layout()->setContentsMargins(0, 0, 0, 0);
+    w->layout()->addWidget(ARRANGE_WIDGET(tr("Read threads"), readSpin, w));
+    w->layout()->addWidget(ARRANGE_WIDGET(tr("Decode threads"), decodeSpin, w));
+    w->layout()->addWidget(ARRANGE_WIDGET(tr("Pipeline depth"), depthSpin, w));
+    return w;
+}
+
+QWidget* PlugSettings::getRecordTimingsOption() {
+    timingsBox = new QCheckBox(this);
+    timingsBox->setChecked(recordTimings());
+    timingsBox->setWhatsThis(
+        tr("Record how long decoding, scaling and layout take. Press F12 in the flow view to show them, "
+           "Ctrl+S exports a trace for chrome://tracing."));
+
+    return ARRANGE_WIDGET(tr("Record timings"), timingsBox, this);
+}
 bool PlugSettings::useCustomLoader() {
     return useCustomLoader_;
 }
@@ -186,4 +354,34 @@ int PlugSettings::referenceWidth() {
 Z::Style PlugSettings::style() {
     return settings_->value("style", "Col").toString();
 }
+bool PlugSettings::virtualized() {
+    return settings_->value("virtualized", false).toBool();
+}
+int PlugSettings::overscan() {
+    return settings_->value("overscan", 600).toInt();
+}
+bool PlugSettings::painted() {
+    return settings_->value("painted", false).toBool();
+}
+int PlugSettings::diskCacheSize() {
+    return settings_->value("diskCacheSize", 1024).toInt();
+}
+int PlugSettings::memoryBudget() {
+    return settings_->value("memoryBudget", 1024).toInt();
+}
+bool PlugSettings::recordTimings() {
+    return settings_->value("recordTimings", false).toBool();
+}
+int PlugSettings::readThreads() {
+    return settings_->value("readThreads", 0).toInt();
+}
+int PlugSettings::decodeThreads() {
+    return settings_->value("decodeThreads", 0).toInt();
+}
+int PlugSettings::pipelineDepth() {
+    return settings_->value("pipelineDepth", 8).toInt();
+}
+bool PlugSettings::embeddedPreviews() {
+    return settings_->value("embeddedPreviews", true).toBool();
+}
 }    // namespace Cathaysia
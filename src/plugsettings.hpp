@@ -17,6 +17,7 @@
 #include "dplugindialog.h"
 #include "flowlayout.h"
 
+class QCheckBox;
 class QComboBox;
 class QSpinBox;
 class QSettings;
@@ -33,6 +34,16 @@ public:
     int      spacing();
     int      referenceWidth();
     Z::Style style();
+    bool     virtualized();
+    int      overscan();
+    bool     painted();
+    int      diskCacheSize();
+    int      memoryBudget();
+    bool     recordTimings();
+    int      readThreads();
+    int      decodeThreads();
+    int      pipelineDepth();
+    bool     embeddedPreviews();
 
     // QDialog
     void accept() override;
@@ -43,11 +54,27 @@ protected:
     QWidget* getLoaderOption();
     QWidget* getSpacingOption();
     QWidget* getRefWidthOption();
+    QWidget* getVirtualizedOption();
+    QWidget* getOverscanOption();
+    QWidget* getPaintedOption();
+    QWidget* getDiskCacheOption();
+    QWidget* getMemoryBudgetOption();
+    QWidget* getRecordTimingsOption();
+    QWidget* getPipelineOption();
+    QWidget* getEmbeddedPreviewsOption();
 
 signals:
     void refWidthChanged(qreal width);
     void spacingChanged(int spacing);
     void signalStyleChanged(Z::Style);
+    void overscanChanged(int overscan);
+    void diskCacheSizeChanged(int mb);
+    void memoryBudgetChanged(int mb);
+    void recordTimingsChanged(bool record);
+    void readThreadsChanged(int count);
+    void decodeThreadsChanged(int count);
+    void pipelineDepthChanged(int depth);
+    void embeddedPreviewsChanged(bool enable);
 
 private:
     QSettings* settings_;
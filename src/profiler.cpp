@@ -0,0 +1,133 @@
+/* ============================================================
+ *
+ * This file is a part of digiKam flow plugin project
+ * https://github.com/cathaysia/digikamflowplugin
+ *
+ * Date        : 2021-05-22
+ * Description : Timings of loading and layout, shown on screen or exported as a trace.
+ *
+ * Copyright (C) 2021-2022 by DragonBillow <DragonBillow at outlook dot com>
+ *
+ * Redistribution and use is allowed according to the terms of the GPL3 license.
+ * For details see the accompanying LICENSE file.
+ *
+ * ============================================================ */
+
+#include "profiler.hpp"
+
+#include <QCoreApplication>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QStringList>
+#include <QThread>
+
+#include <algorithm>
+
+// keep the trace of a long session bounded, the stats keep counting
+constexpr int kMaxEvents = 1 << 20;
+
+Profiler::Scope::Scope(char const* name, int index)
+    : name_(name)
+    , index_(index)
+    , start_(Profiler::instance()->enabled() ? Profiler::instance()->now() : -1) { }
+
+Profiler::Scope::~Scope() {
+    if(start_ < 0) return;
+    auto* profiler = Profiler::instance();
+    profiler->record(name_, start_, profiler->now(), index_);
+}
+
+Profiler::Profiler() : enabled_(false) {
+    clock_.start();
+}
+
+Profiler* Profiler::instance() {
+    static Profiler profiler;
+    return &profiler;
+}
+
+void Profiler::setEnabled(bool enabled) {
+    enabled_ = enabled;
+}
+
+bool Profiler::enabled() const {
+    return enabled_;
+}
+
+qint64 Profiler::now() const {
+    return clock_.nsecsElapsed() / 1000;
+}
+
+void Profiler::record(char const* name, qint64 start, qint64 end, int index) {
+    if(!enabled() || start < 0) return;
+    qint64 duration = std::max<qint64>(end - start, 0);
+
+    QMutexLocker locker(&mutex_);
+    auto&        stat = stats_[QLatin1String(name)];
+    ++stat.count;
+    stat.total += duration;
+    stat.max = std::max(stat.max, duration);
+
+    if(events_.count() >= kMaxEvents) return;
+    // small numbers read better than thread handles in the trace viewer
+    auto thread = quintptr(QThread::currentThreadId());
+    if(!threads_.contains(thread)) threads_.insert(thread, threads_.count() + 1);
+    events_.append(Event { name, index, start, duration, threads_.value(thread) });
+}
+
+void Profiler::clear() {
+    QMutexLocker locker(&mutex_);
+    events_.clear();
+    stats_.clear();
+    threads_.clear();
+}
+
+QHash<QString, Profiler::Stat> Profiler::stats() const {
+    QMutexLocker locker(&mutex_);
+    return stats_;
+}
+
+QString Profiler::summary() const {
+    auto        stats = this->stats();
+    QStringList names = stats.keys();
+    names.sort();
+
+    QStringList lines;
+    for(auto& name: names) {
+        auto& stat = stats.value(name);
+        lines << QString::asprintf("%-10s %7d  mean %8.2f ms  max %8.2f ms", qPrintable(name), stat.count,
+                                   stat.total / 1000. / stat.count, stat.max / 1000.);
+    }
+    return lines.join(QLatin1Char('\n'));
+}
+
+// Complete events ("ph": "X") of the Chrome trace-event format, timestamps in microseconds
+bool Profiler::exportTrace(QString const& path) const {
+    QVector<Event> events;
+    {
+        QMutexLocker locker(&mutex_);
+        events = events_;
+    }
+
+    QJsonArray trace;
+    for(auto& event: events) {
+        QJsonObject item;
+        item["name"] = QLatin1String(event.name);
+        item["cat"]  = QStringLiteral("flowview");
+        item["ph"]   = QStringLiteral("X");
+        item["ts"]   = event.start;
+        item["dur"]  = event.duration;
+        item["pid"]  = QCoreApplication::applicationPid();
+        item["tid"]  = event.thread;
+        if(event.index >= 0) item["args"] = QJsonObject { { "index", event.index } };
+        trace.append(item);
+    }
+
+    QSaveFile file(path);
+    if(!file.open(QIODevice::WriteOnly)) return false;
+    file.write(QJsonDocument(QJsonObject { { "traceEvents", trace } }).toJson(QJsonDocument::Compact));
+    return file.commit();
+}
@@ -0,0 +1,85 @@
+/* ============================================================
+ *
+ * This file is a part of digiKam flow plugin project
+ * https://github.com/cathaysia/digikamflowplugin
+ *
+ * Date        : 2021-05-22
+ * Description : Timings of loading and layout, shown on screen or exported as a trace.
+ *
+ * Copyright (C) 2021-2022 by DragonBillow <DragonBillow at outlook dot com>
+ *
+ * Redistribution and use is allowed according to the terms of the GPL3 license.
+ * For details see the accompanying LICENSE file.
+ *
+ * ============================================================ */
+
+#pragma once
+
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+
+/**
+ * Profiler collects how long every step of showing a picture takes, from any
+ * thread. It does nothing until enabled, so the calls stay in release builds.
+ * The summary feeds the HUD of PicDialog and exportTrace() writes the Chrome
+ * trace-event format, which chrome://tracing and Perfetto open.
+ */
+class Profiler {
+public:
+    // times of one step, in microseconds
+    struct Stat {
+        int    count = 0;
+        qint64 total = 0;
+        qint64 max   = 0;
+    };
+
+    // Records the lifetime of a scope
+    class Scope {
+    public:
+        explicit Scope(char const* name, int index = -1);
+        ~Scope();
+
+    private:
+        char const* name_;
+        int         index_;
+        qint64      start_;
+    };
+
+    static Profiler* instance();
+
+    void setEnabled(bool enabled);
+    bool enabled() const;
+
+    // microseconds since the profiler was created
+    qint64 now() const;
+    // name must be a string literal, index is the tile or -1
+    void record(char const* name, qint64 start, qint64 end, int index = -1);
+    void clear();
+
+    QHash<QString, Stat> stats() const;
+    // one line per step: count, mean and max in milliseconds
+    QString summary() const;
+    bool    exportTrace(QString const& path) const;
+
+private:
+    struct Event {
+        char const* name;
+        int         index;
+        qint64      start;
+        qint64      duration;
+        int         thread;
+    };
+
+    Profiler();
+
+    QAtomicInt           enabled_;
+    QElapsedTimer        clock_;
+    mutable QMutex       mutex_;
+    QVector<Event>       events_;
+    QHash<QString, Stat> stats_;
+    QHash<quintptr, int> threads_;
+};
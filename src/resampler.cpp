@@ -0,0 +1,301 @@
+/* ============================================================
+ *
+ * This file is a part of digiKam flow plugin project
+ * https://github.com/cathaysia/digikamflowplugin
+ *
+ * Date        : 2021-05-22
+ * Description : Area-averaging downscaler for 32 bits pictures.
+ *
+ * Copyright (C) 2021-2022 by DragonBillow <DragonBillow at outlook dot com>
+ *
+ * Redistribution and use is allowed according to the terms of the GPL3 license.
+ * For details see the accompanying LICENSE file.
+ *
+ * ============================================================ */
+
+#include "resampler.hpp"
+
+#include <QVector>
+#include <QtMath>
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RESAMPLER_X86
+#include <immintrin.h>
+#if defined(__GNUC__) || defined(__clang__)
+#define RESAMPLER_AVX2 __attribute__((target("avx2")))
+#else
+#define RESAMPLER_AVX2
+#include <intrin.h>
+#endif
+#endif
+
+/**
+ * Two separable passes. The horizontal pass turns every source row the region
+ * touches into a row of 16 bits channels with kExtraBits more precision, the
+ * vertical pass blends those rows and rounds back to 8 bits. Weights are fixed
+ * point with kWeightBits, the weights of one target pixel always sum to 1 and
+ * are never negative.
+ *
+ * Every channel value and weight fits a signed 16 bits integer, so SSE2's
+ * madd can multiply and add two of them at once.
+ */
+namespace {
+
+constexpr int kWeightBits = 14;
+constexpr int kExtraBits  = 7;
+constexpr int kHorzShift  = kWeightBits - kExtraBits;
+constexpr int kVertShift  = kWeightBits + kExtraBits;
+
+// the source pixels covered by one target pixel
+struct Span {
+    int first;
+    int count;
+    int offset;    // of the first weight
+};
+
+struct Filter {
+    QVector<Span>   spans;
+    QVector<qint16> weights;
+};
+
+// target pixel i covers [begin + i * scale, begin + (i + 1) * scale) of the source
+Filter areaFilter(qreal begin, qreal length, int target, int limit) {
+    Filter filter;
+    filter.spans.reserve(target);
+    qreal scale = length / target;
+    for(int i = 0; i < target; ++i) {
+        qreal a     = qBound(qreal(0), begin + i * scale, qreal(limit));
+        qreal b     = std::min(begin + (i + 1) * scale, qreal(limit));
+        int   first = std::min(int(qFloor(a)), limit - 1);
+        int   last  = std::max(std::min(int(qCeil(b)), limit), first + 1);
+
+        Span  span { first, last - first, filter.weights.count() };
+        qreal width = std::max(b - a, qreal(1e-6));
+        qreal cover = 0;
+        int   done  = 0;
+        // a weight is the step of the rounded cumulative cover, so the rounding error is spread over the
+        // span: the weights never go negative and always sum to 1, rounding does not change the brightness
+        for(int x = first; x < last; ++x) {
+            cover += std::max(std::min(b, qreal(x + 1)) - std::max(a, qreal(x)), qreal(0));
+            int total = x + 1 == last ? 1 << kWeightBits
+                                      : std::min(qRound(cover / width * (1 << kWeightBits)), 1 << kWeightBits);
+            filter.weights.append(qint16(total - done));
+            done = total;
+        }
+        filter.spans.append(span);
+    }
+    return filter;
+}
+
+#ifndef RESAMPLER_X86
+
+void horizontalScalar(uchar const* src, quint16* dst, Filter const& filter) {
+    for(auto& span: filter.spans) {
+        int           acc[4] = { 0, 0, 0, 0 };
+        qint16 const* weight = filter.weights.constData() + span.offset;
+        uchar const*  pixel  = src + span.first * 4;
+        for(int k = 0; k < span.count; ++k, pixel += 4)
+            for(int c = 0; c < 4; ++c) acc[c] += pixel[c] * weight[k];
+        for(int c = 0; c < 4; ++c) *dst++ = quint16((acc[c] + (1 << (kHorzShift - 1))) >> kHorzShift);
+    }
+}
+
+#endif
+
+// n rows of the horizontal pass are blended into dst, values [from, count) of each row
+void verticalScalar(quint16 const* const* rows, qint16 const* weights, int n, uchar* dst, int from, int count) {
+    for(int i = from; i < count; ++i) {
+        int acc = 1 << (kVertShift - 1);
+        for(int k = 0; k < n; ++k) acc += rows[k][i] * weights[k];
+        dst[i] = uchar(std::min(acc >> kVertShift, 255));
+    }
+}
+
+#ifdef RESAMPLER_X86
+
+void horizontalSse2(uchar const* src, quint16* dst, Filter const& filter) {
+    __m128i const zero  = _mm_setzero_si128();
+    __m128i const round = _mm_set1_epi32(1 << (kHorzShift - 1));
+    for(auto& span: filter.spans) {
+        __m128i       acc    = round;
+        qint16 const* weight = filter.weights.constData() + span.offset;
+        uchar const*  pixel  = src + span.first * 4;
+        for(int k = 0; k < span.count; ++k, pixel += 4) {
+            int value;
+            memcpy(&value, pixel, 4);
+            // channels in the even 16 bits lanes, the weight in the even lanes too
+            __m128i px = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(value), zero), zero);
+            acc        = _mm_add_epi32(acc, _mm_madd_epi16(px, _mm_set1_epi32(quint16(weight[k]))));
+        }
+        acc = _mm_srai_epi32(acc, kHorzShift);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(dst), _mm_packs_epi32(acc, acc));
+        dst += 4;
+    }
+}
+
+// weights of two rows in one 32 bits lane, madd blends two rows at once
+inline int pairWeight(qint16 const* weights, int k, int n) {
+    return quint16(weights[k]) | (k + 1 < n ? int(quint16(weights[k + 1])) << 16 : 0);
+}
+
+void verticalSse2(quint16 const* const* rows, qint16 const* weights, int n, uchar* dst, int from, int count) {
+    __m128i const zero  = _mm_setzero_si128();
+    __m128i const round = _mm_set1_epi32(1 << (kVertShift - 1));
+    int           i     = from;
+    for(; i + 8 <= count; i += 8) {
+        __m128i lo = round, hi = round;
+        for(int k = 0; k < n; k += 2) {
+            __m128i w = _mm_set1_epi32(pairWeight(weights, k, n));
+            __m128i a = _mm_loadu_si128(reinterpret_cast<__m128i const*>(rows[k] + i));
+            __m128i b = k + 1 < n ? _mm_loadu_si128(reinterpret_cast<__m128i const*>(rows[k + 1] + i)) : zero;
+            lo        = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), w));
+            hi        = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), w));
+        }
+        __m128i v = _mm_packs_epi32(_mm_srai_epi32(lo, kVertShift), _mm_srai_epi32(hi, kVertShift));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(v, v));
+    }
+    verticalScalar(rows, weights, n, dst, i, count);
+}
+
+RESAMPLER_AVX2
+void verticalAvx2(quint16 const* const* rows, qint16 const* weights, int n, uchar* dst, int from, int count) {
+    __m256i const zero  = _mm256_setzero_si256();
+    __m256i const round = _mm256_set1_epi32(1 << (kVertShift - 1));
+    int           i     = from;
+    for(; i + 16 <= count; i += 16) {
+        __m256i lo = round, hi = round;
+        for(int k = 0; k < n; k += 2) {
+            __m256i w = _mm256_set1_epi32(pairWeight(weights, k, n));
+            __m256i a = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(rows[k] + i));
+            __m256i b = k + 1 < n ? _mm256_loadu_si256(reinterpret_cast<__m256i const*>(rows[k + 1] + i)) : zero;
+            lo        = _mm256_add_epi32(lo, _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), w));
+            hi        = _mm256_add_epi32(hi, _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), w));
+        }
+        // unpack and pack both work inside the 128 bits lanes, so the order is kept
+        __m256i v = _mm256_packs_epi32(_mm256_srai_epi32(lo, kVertShift), _mm256_srai_epi32(hi, kVertShift));
+        v         = _mm256_permute4x64_epi64(_mm256_packus_epi16(v, v), 0x08);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm256_castsi256_si128(v));
+    }
+    verticalSse2(rows, weights, n, dst, i, count);
+}
+
+bool hasAvx2() {
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#else
+    int info[4];
+    __cpuid(info, 0);
+    if(info[0] < 7) return false;
+    __cpuidex(info, 7, 0);
+    return info[1] & (1 << 5);
+#endif
+}
+
+#endif
+
+struct Kernel {
+    char const* name;
+    void (*horizontal)(uchar const*, quint16*, Filter const&);
+    void (*vertical)(quint16 const* const*, qint16 const*, int, uchar*, int, int);
+};
+
+Kernel const& currentKernel() {
+    // clang-format off
+    static Kernel const k =
+#ifdef RESAMPLER_X86
+        hasAvx2() ? Kernel { "avx2", horizontalSse2, verticalAvx2 }
+                  : Kernel { "sse2", horizontalSse2, verticalSse2 };
+#else
+        Kernel { "scalar", horizontalScalar, verticalScalar };
+#endif
+    // clang-format on
+    return k;
+}
+
+QImage::Format workFormat(QImage const& img) {
+    return img.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32;
+}
+
+}    // namespace
+
+namespace Resampler {
+
+QImage scaled(QImage const& image, QRectF const& region, QSize const& target) {
+    if(image.isNull() || target.isEmpty() || region.isEmpty()) return QImage();
+
+    // averaging only makes sense for shrinking
+    if(region.width() < target.width() || region.height() < target.height()) {
+        QImage part = image.copy(region.toAlignedRect());
+        return part.scaled(target, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    }
+
+    QImage src  = converted(image);
+    Filter horz = areaFilter(region.x(), region.width(), target.width(), src.width());
+    Filter vert = areaFilter(region.y(), region.height(), target.height(), src.height());
+
+    // The spans only move down, so the horizontal pass keeps a ring of the rows one target
+    // row blends, and only the source rows the region touches go through it once
+    int stride = target.width() * 4;
+    int ring   = 0;
+    for(auto& span: vert.spans) ring = std::max(ring, span.count);
+
+    auto&                   k    = currentKernel();
+    int                     next = 0;
+    QVector<quint16>        rows(ring * stride);
+    QImage                  dst(target, src.format());
+    QVector<quint16 const*> lines;
+    for(int y = 0; y < target.height(); ++y) {
+        auto& span = vert.spans.at(y);
+        for(next = std::max(next, span.first); next < span.first + span.count; ++next)
+            k.horizontal(src.constScanLine(next), rows.data() + (next % ring) * stride, horz);
+        lines.resize(span.count);
+        for(int i = 0; i < span.count; ++i) lines[i] = rows.constData() + ((span.first + i) % ring) * stride;
+        k.vertical(lines.constData(), vert.weights.constData() + span.offset, span.count, dst.scanLine(y), 0, stride);
+    }
+    return dst;
+}
+
+QImage cropped(QImage const& src, QSize const& target) {
+    if(src.isNull() || target.isEmpty()) return QImage();
+    qreal scale = std::max(qreal(target.width()) / src.width(), qreal(target.height()) / src.height());
+    return scaled(src, QRectF(0, 0, target.width() / scale, target.height() / scale), target);
+}
+
+QImage fitted(QImage const& src, QSize const& box) {
+    if(src.isNull() || box.isEmpty()) return QImage();
+    if(src.width() <= box.width() && src.height() <= box.height()) return src;
+    QSize target = src.size().scaled(box, Qt::KeepAspectRatio).expandedTo(QSize(1, 1));
+    return scaled(src, QRectF(QPointF(0, 0), src.size()), target);
+}
+
+// exact sums, the fixed point weights of scaled() would round every pixel of a big picture
+QRgb average(QImage const& src) {
+    if(src.isNull()) return qRgb(0, 0, 0);
+    QImage  img    = converted(src);
+    quint64 sum[3] = { 0, 0, 0 };
+    for(int y = 0; y < img.height(); ++y) {
+        auto const* line = reinterpret_cast<QRgb const*>(img.constScanLine(y));
+        for(int x = 0; x < img.width(); ++x) {
+            sum[0] += qRed(line[x]);
+            sum[1] += qGreen(line[x]);
+            sum[2] += qBlue(line[x]);
+        }
+    }
+    quint64 count = quint64(img.width()) * img.height();
+    return qRgb(int((sum[0] + count / 2) / count), int((sum[1] + count / 2) / count),
+                int((sum[2] + count / 2) / count));
+}
+
+QImage converted(QImage const& src) {
+    return src.convertToFormat(workFormat(src));
+}
+
+char const* kernel() {
+    return currentKernel().name;
+}
+
+}    // namespace Resampler
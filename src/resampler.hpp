@@ -0,0 +1,48 @@
+/* ============================================================
+ *
+ * This file is a part of digiKam flow plugin project
+ * https://github.com/cathaysia/digikamflowplugin
+ *
+ * Date        : 2021-05-22
+ * Description : Area-averaging downscaler for 32 bits pictures.
+ *
+ * Copyright (C) 2021-2022 by DragonBillow <DragonBillow at outlook dot com>
+ *
+ * Redistribution and use is allowed according to the terms of the GPL3 license.
+ * For details see the accompanying LICENSE file.
+ *
+ * ============================================================ */
+
+#pragma once
+
+#include <QImage>
+#include <QRectF>
+#include <QSize>
+
+/**
+ * Resampler averages every source pixel a target pixel covers, so downscaled
+ * tiles do not alias like FastTransformation and cost much less than
+ * SmoothTransformation. It works on RGB32 and ARGB32_Premultiplied, other
+ * formats are converted first. The vertical pass uses AVX2 or SSE2 when the
+ * CPU has them, a scalar loop otherwise. Upscaling falls back to QImage::scaled.
+ *
+ * All functions are thread safe.
+ */
+namespace Resampler {
+
+// scale region of src to target in one pass, region is in source pixels
+QImage scaled(QImage const& src, QRectF const& region, QSize const& target);
+// cover target keeping the aspect ratio and crop the rest, like
+// scaled(target, Qt::KeepAspectRatioByExpanding).copy(0, 0, target.width(), target.height())
+QImage cropped(QImage const& src, QSize const& target);
+// fit inside box keeping the aspect ratio, never upscale
+QImage fitted(QImage const& src, QSize const& box);
+// mean color of all pixels, opaque
+QRgb average(QImage const& src);
+// src in the format the functions work in, a picture scaled many times is converted once
+QImage converted(QImage const& src);
+
+// name of the kernel used on this CPU: "avx2", "sse2" or "scalar"
+char const* kernel();
+
+}    // namespace Resampler
@@ -0,0 +1,340 @@
+/* ============================================================
+ *
+ * This file is a part of digiKam flow plugin project
+ * https://github.com/cathaysia/digikamflowplugin
+ *
+ * Date        : 2021-05-22
+ * Description : On-disk cache of reduced pictures for the custom loader.
+ *
+ * Copyright (C) 2021-2022 by DragonBillow <DragonBillow at outlook dot com>
+ *
+ * Redistribution and use is allowed according to the terms of the GPL3 license.
+ * For details see the accompanying LICENSE file.
+ *
+ * ============================================================ */
+
+#include "thumbcache.hpp"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QVector>
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef Q_OS_UNIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "digikam_debug.h"
+
+namespace {
+
+struct Header {
+    quint32 magic;
+    quint32 version;
+    qint32  width;
+    qint32  height;
+    qint32  bytesPerLine;
+    qint32  format;
+};
+
+constexpr quint32 kMagic   = 0x43545646;    // "FVTC"
+constexpr quint32 kVersion = 1;
+
+constexpr quint32 kColorMagic = 0x4c435646;    // "FVCL"
+// new colors written at once, the file is rewritten as a whole
+constexpr int kColorBatch = 64;
+
+struct ColorHeader {
+    quint32 magic;
+    quint32 version;
+    qint32  count;
+    qint32  reserved;
+};
+
+struct ColorEntry {
+    quint64 key;
+    quint32 color;
+    quint32 reserved;
+};
+
+quint64 colorKey(QString const& path) {
+    quint64 key;
+    std::memcpy(&key, QCryptographicHash::hash(path.toUtf8(), QCryptographicHash::Sha1).constData(), sizeof(key));
+    return key;
+}
+
+/**
+ * The bytes of an entry. On unix the file is mapped and its descriptor closed
+ * at once, a live image holds the pages but no descriptor; elsewhere the file
+ * is read.
+ */
+class Mapping {
+public:
+    explicit Mapping(QString const& name);
+    ~Mapping();
+
+    uchar const* data() const {
+        return data_;
+    }
+    qint64 size() const {
+        return size_;
+    }
+
+private:
+    uchar const* data_ = nullptr;
+    qint64       size_ = 0;
+#ifndef Q_OS_UNIX
+    QByteArray bytes_;
+#endif
+};
+
+// touches the file too, the mtime of the entries is the LRU order of the next session
+Mapping::Mapping(QString const& name) {
+#ifdef Q_OS_UNIX
+    int fd = ::open(QFile::encodeName(name).constData(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0) return;
+    struct stat st;
+    if(::fstat(fd, &st) == 0 && st.st_size >= qint64(sizeof(Header))) {
+        void* data = ::mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if(data != MAP_FAILED) {
+            data_ = static_cast<uchar const*>(data);
+            size_ = st.st_size;
+            ::futimens(fd, nullptr);
+        }
+    }
+    ::close(fd);
+#else
+    QFile file(name);
+    if(!file.open(QIODevice::ReadOnly)) return;
+    bytes_ = file.readAll();
+    data_  = reinterpret_cast<uchar const*>(bytes_.constData());
+    size_  = bytes_.size();
+    file.setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime);
+#endif
+}
+
+Mapping::~Mapping() {
+#ifdef Q_OS_UNIX
+    if(data_) ::munmap(const_cast<uchar*>(data_), size_t(size_));
+#endif
+}
+
+// the pixels are used in place of the mapping, unmap after the image is gone
+void releaseMapping(void* mapping) {
+    delete static_cast<Mapping*>(mapping);
+}
+
+}    // namespace
+
+ThumbCache::ThumbCache(QString const& dir)
+    : dir_(dir)
+    , capacity_(0)
+    , used_(-1)
+    , colorsLoaded_(false)
+    , colorsDirty_(0) {
+    if(dir_.isEmpty())
+        dir_ = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + QStringLiteral("/flowview");
+    QDir().mkpath(dir_);
+}
+
+ThumbCache::~ThumbCache() {
+    QMutexLocker locker(&mutex_);
+    saveColors();
+}
+
+void ThumbCache::setCapacity(int mb) {
+    QMutexLocker locker(&mutex_);
+    capacity_ = qint64(std::max(mb, 0)) * 1024 * 1024;
+}
+
+int ThumbCache::capacity() const {
+    QMutexLocker locker(&mutex_);
+    return int(capacity_ / 1024 / 1024);
+}
+
+bool ThumbCache::enabled() const {
+    QMutexLocker locker(&mutex_);
+    return capacity_ > 0;
+}
+
+QString ThumbCache::fileName(TileInfo const& info, QSize const& target) const {
+    TileInfo stamped = info;
+    if(stamped.modified < 0 || stamped.bytes < 0) stamped.stamp();
+    QByteArray key = info.url.toLocalFile().toUtf8();
+    key += '|' + QByteArray::number(stamped.modified);
+    key += '|' + QByteArray::number(stamped.bytes);
+    key += '|' + QByteArray::number(target.width()) + 'x' + QByteArray::number(target.height());
+    auto hash = QCryptographicHash::hash(key, QCryptographicHash::Sha1).toHex();
+    return dir_ + QLatin1Char('/') + QString::fromLatin1(hash) + QStringLiteral(".thumb");
+}
+
+QImage ThumbCache::find(TileInfo const& info, QSize const& target) {
+    if(!enabled()) return QImage();
+
+    QString name    = fileName(info, target);
+    auto*   mapping = new Mapping(name);
+    if(mapping->size() < qint64(sizeof(Header))) {
+        delete mapping;
+        return QImage();
+    }
+
+    Header header;
+    std::memcpy(&header, mapping->data(), sizeof(Header));
+    qint64 expected = qint64(sizeof(Header)) + qint64(header.bytesPerLine) * header.height;
+    // insert() only writes these two formats
+    bool format = header.format == QImage::Format_RGB32 || header.format == QImage::Format_ARGB32_Premultiplied;
+    if(header.magic != kMagic || header.version != kVersion || mapping->size() != expected || !format
+       || header.width <= 0 || header.height <= 0 || header.bytesPerLine < qint64(header.width) * 4) {
+        delete mapping;
+        return QImage();
+    }
+
+    const uchar* pixels = mapping->data() + sizeof(Header);
+    QImage       img(pixels, header.width, header.height, header.bytesPerLine, QImage::Format(header.format),
+                     releaseMapping, mapping);
+    // a rejected image never calls releaseMapping
+    if(img.isNull()) {
+        delete mapping;
+        return QImage();
+    }
+
+    QMutexLocker locker(&mutex_);
+    auto         it = index_.find(name);
+    if(it != index_.end()) order_.splice(order_.end(), order_, it->order);
+    return img;
+}
+
+void ThumbCache::insert(TileInfo const& info, QSize const& target, QImage const& img) {
+    if(!enabled() || img.isNull()) return;
+    scan();
+
+    QImage tmp = img;
+    if(tmp.format() != QImage::Format_RGB32 && tmp.format() != QImage::Format_ARGB32_Premultiplied)
+        tmp = tmp.convertToFormat(tmp.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied
+                                                        : QImage::Format_RGB32);
+
+    Header header { kMagic, kVersion, tmp.width(), tmp.height(), int(tmp.bytesPerLine()), int(tmp.format()) };
+
+    QSaveFile file(fileName(info, target));
+    if(!file.open(QIODevice::WriteOnly)) return;
+    file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+    file.write(reinterpret_cast<const char*>(tmp.constBits()), qint64(tmp.bytesPerLine()) * tmp.height());
+    if(!file.commit()) {
+        qCDebug(DIGIKAM_DPLUGIN_GENERIC_LOG) << "Write thumbnail cache failed: " << file.fileName();
+        return;
+    }
+
+    QMutexLocker locker(&mutex_);
+    add(file.fileName(), qint64(sizeof(Header)) + qint64(tmp.bytesPerLine()) * tmp.height());
+    evict();
+}
+
+// List the cache dir once, without the lock; after that the entries are tracked in memory
+void ThumbCache::scan() {
+    {
+        QMutexLocker locker(&mutex_);
+        if(used_ >= 0) return;
+    }
+
+    // oldest first
+    auto entries = QDir(dir_).entryInfoList(QStringList() << QStringLiteral("*.thumb"), QDir::Files,
+                                            QDir::Time | QDir::Reversed);
+
+    QMutexLocker locker(&mutex_);
+    // another thread scanned meanwhile
+    if(used_ >= 0) return;
+    used_ = 0;
+    for(auto& it: entries) add(it.absoluteFilePath(), it.size());
+}
+
+// Called with the mutex held, name becomes the most recently used entry
+void ThumbCache::add(QString const& name, qint64 size) {
+    auto it = index_.find(name);
+    if(it != index_.end()) {
+        used_ -= it->size;
+        order_.erase(it->order);
+        index_.erase(it);
+    }
+    index_.insert(name, Entry { size, order_.insert(order_.end(), name) });
+    used_ += size;
+}
+
+// Called with the mutex held, removes the least recently used entries until only 90% of capacity is used
+void ThumbCache::evict() {
+    if(used_ <= capacity_) return;
+
+    while(!order_.empty() && used_ > capacity_ * 9 / 10) {
+        QString oldest = order_.front();
+        order_.pop_front();
+        used_ -= index_.take(oldest).size;
+        QFile::remove(oldest);
+    }
+}
+
+QRgb ThumbCache::color(QString const& path) {
+    QMutexLocker locker(&mutex_);
+    loadColors();
+    return colors_.value(colorKey(path), 0);
+}
+
+void ThumbCache::setColor(QString const& path, QRgb color) {
+    quint64      key = colorKey(path);
+    QMutexLocker locker(&mutex_);
+    loadColors();
+    auto it = colors_.find(key);
+    if(it != colors_.end() && *it == color) return;
+    colors_.insert(key, color);
+    if(++colorsDirty_ >= kColorBatch) saveColors();
+}
+
+// Called with the mutex held
+void ThumbCache::loadColors() {
+    if(colorsLoaded_) return;
+    colorsLoaded_ = true;
+
+    QFile file(dir_ + QStringLiteral("/colors"));
+    if(!file.open(QIODevice::ReadOnly)) return;
+    QByteArray data = file.readAll();
+    if(data.size() < int(sizeof(ColorHeader))) return;
+
+    ColorHeader header;
+    std::memcpy(&header, data.constData(), sizeof(ColorHeader));
+    if(header.magic != kColorMagic || header.version != kVersion || header.count < 0
+       || data.size() != int(sizeof(ColorHeader)) + header.count * int(sizeof(ColorEntry)))
+        return;
+
+    colors_.reserve(header.count);
+    auto const* entries = reinterpret_cast<ColorEntry const*>(data.constData() + sizeof(ColorHeader));
+    for(int i = 0; i < header.count; ++i) colors_.insert(entries[i].key, entries[i].color);
+}
+
+// Called with the mutex held, the colors are only written when the cache is enabled
+void ThumbCache::saveColors() {
+    if(!colorsDirty_ || !capacity_) return;
+
+    QVector<ColorEntry> entries;
+    entries.reserve(colors_.count());
+    for(auto it = colors_.cbegin(); it != colors_.cend(); ++it) entries.append(ColorEntry { it.key(), it.value(), 0 });
+    ColorHeader header { kColorMagic, kVersion, entries.count(), 0 };
+
+    QSaveFile file(dir_ + QStringLiteral("/colors"));
+    if(!file.open(QIODevice::WriteOnly)) return;
+    file.write(reinterpret_cast<const char*>(&header), sizeof(ColorHeader));
+    file.write(reinterpret_cast<const char*>(entries.constData()), qint64(entries.count()) * sizeof(ColorEntry));
+    if(!file.commit()) {
+        qCDebug(DIGIKAM_DPLUGIN_GENERIC_LOG) << "Write colors failed: " << file.fileName();
+        return;
+    }
+    colorsDirty_ = 0;
+}
@@ -0,0 +1,86 @@
+/* ============================================================
+ *
+ * This file is a part of digiKam flow plugin project
+ * https://github.com/cathaysia/digikamflowplugin
+ *
+ * Date        : 2021-05-22
+ * Description : On-disk cache of reduced pictures for the custom loader.
+ *
+ * Copyright (C) 2021-2022 by DragonBillow <DragonBillow at outlook dot com>
+ *
+ * Redistribution and use is allowed according to the terms of the GPL3 license.
+ * For details see the accompanying LICENSE file.
+ *
+ * ============================================================ */
+
+#pragma once
+
+#include <QHash>
+#include <QImage>
+#include <QMutex>
+#include <QSize>
+#include <QString>
+
+#include <list>
+
+#include "tileinfo.hpp"
+
+/**
+ * Reduced pictures are stored as raw pixels behind a small header, so a hit
+ * is a memory map instead of a decode. The descriptor is closed once the file
+ * is mapped, so the images of a big album do not exhaust the descriptors.
+ * An entry is keyed by path, mtime, file size and target resolution, so a
+ * changed file never hits an old entry. The mtime and size come from the
+ * TileInfo when it has them, the file is only asked when it does not.
+ * When the cache grows over its capacity the least recently used entries
+ * are removed. The dir is listed once, ordered by mtime, the entries are then
+ * tracked in memory.
+ *
+ * The mean color of every picture is kept too, keyed by path only, so a tile
+ * has a placeholder close to its picture before anything is read. It is a few
+ * bytes per picture, all of them stay in memory and in one file.
+ */
+class ThumbCache {
+public:
+    explicit ThumbCache(QString const& dir = QString());
+    ~ThumbCache();
+
+    // capacity in MB, 0 disables the cache
+    void setCapacity(int mb);
+    int  capacity() const;
+
+    QImage find(TileInfo const& info, QSize const& target);
+    void   insert(TileInfo const& info, QSize const& target, QImage const& img);
+
+    // 0 when the color of path is not known
+    QRgb color(QString const& path);
+    void setColor(QString const& path, QRgb color);
+
+private:
+    struct Entry {
+        qint64                       size;
+        std::list<QString>::iterator order;
+    };
+
+    QString fileName(TileInfo const& info, QSize const& target) const;
+    // capacity_ > 0, read under the mutex since the loader threads call find() and insert()
+    bool    enabled() const;
+    void    scan();
+    void    add(QString const& name, qint64 size);
+    void    evict();
+    void    loadColors();
+    void    saveColors();
+
+    QString        dir_;
+    mutable QMutex mutex_;
+    qint64         capacity_;
+    // -1 until the cache dir is scanned
+    qint64 used_;
+    // file names, least recently used first
+    std::list<QString>    order_;
+    QHash<QString, Entry> index_;
+    // by the first 8 bytes of the SHA1 of the path
+    QHash<quint64, QRgb> colors_;
+    bool                 colorsLoaded_;
+    int                  colorsDirty_;
+};
@@ -0,0 +1,100 @@
+/* ============================================================
+ *
+ * This file is a part of digiKam flow plugin project
+ * https://github.com/cathaysia/digikamflowplugin
+ *
+ * Date        : 2021-05-22
+ * Description : Memory budget shared by the tiles of all flow views.
+ *
+ * Copyright (C) 2021-2022 by DragonBillow <DragonBillow at outlook dot com>
+ *
+ * Redistribution and use is allowed according to the terms of the GPL3 license.
+ * For details see the accompanying LICENSE file.
+ *
+ * ============================================================ */
+
+#include "tilebudget.hpp"
+
+#include <QPair>
+#include <QVector>
+
+#include <algorithm>
+
+#include "aspectratiopixmaplabel.hpp"
+
+namespace {
+
+// the viewer needs the tiles of one 4K screen and their neighbours, without a budget it keeps four times that
+constexpr int kMinCache     = 64;
+constexpr int kDefaultCache = 256;
+
+}    // namespace
+
+TileBudget* TileBudget::instance() {
+    static TileBudget budget;
+    return &budget;
+}
+
+void TileBudget::setBudget(int mb) {
+    budget_ = qint64(std::max(mb, 0)) * 1024 * 1024;
+    evict(nullptr);
+}
+
+int TileBudget::budget() const {
+    return int(budget_ / 1024 / 1024);
+}
+
+qint64 TileBudget::used() const {
+    return used_;
+}
+
+void TileBudget::insert(AspectRatioPixmapLabel* lbl, qint64 bytes) {
+    remove(lbl);
+    entries_.insert(lbl, Entry { bytes, ++clock_ });
+    used_ += bytes;
+    evict(lbl);
+}
+
+void TileBudget::remove(AspectRatioPixmapLabel* lbl) {
+    auto it = entries_.find(lbl);
+    if(it == entries_.end()) return;
+    used_ -= it->bytes;
+    entries_.erase(it);
+}
+
+void TileBudget::touch(AspectRatioPixmapLabel* lbl) {
+    auto it = entries_.find(lbl);
+    if(it != entries_.end()) it->stamp = ++clock_;
+}
+
+void TileBudget::charge(qint64 bytes) {
+    used_ += bytes;
+    if(bytes > 0) evict(nullptr);
+}
+
+// a quarter of the budget, but never too little for the viewer
+int TileBudget::cacheBudget() const {
+    if(!budget_) return kDefaultCache;
+    return std::max(budget() / 4, kMinCache);
+}
+
+qint64 TileBudget::limit() const {
+    return std::max(budget_ - 2 * qint64(cacheBudget()) * 1024 * 1024, qint64(0));
+}
+
+// drop the least recently visible pictures until 90% of the limit is used
+void TileBudget::evict(AspectRatioPixmapLabel* keep) {
+    if(!budget_ || used_ <= limit()) return;
+
+    QVector<QPair<quint64, AspectRatioPixmapLabel*>> order;
+    order.reserve(entries_.count());
+    for(auto it = entries_.cbegin(); it != entries_.cend(); ++it) order.append(qMakePair(it->stamp, it.key()));
+    std::sort(order.begin(), order.end());
+
+    for(auto& it: order) {
+        if(used_ <= limit() * 9 / 10) break;
+        // never take the picture away from the screen
+        if(it.second == keep || !it.second->visibleRegion().isEmpty()) continue;
+        it.second->evict();
+    }
+}
@@ -0,0 +1,64 @@
+/* ============================================================
+ *
+ * This file is a part of digiKam flow plugin project
+ * https://github.com/cathaysia/digikamflowplugin
+ *
+ * Date        : 2021-05-22
+ * Description : Memory budget shared by the tiles of all flow views.
+ *
+ * Copyright (C) 2021-2022 by DragonBillow <DragonBillow at outlook dot com>
+ *
+ * Redistribution and use is allowed according to the terms of the GPL3 license.
+ * For details see the accompanying LICENSE file.
+ *
+ * ============================================================ */
+
+#pragma once
+
+#include <QHash>
+
+class AspectRatioPixmapLabel;
+
+/**
+ * Every label with a picture accounts its pixels here. When all tiles use more
+ * than the budget, the least recently visible ones drop their pictures and load
+ * them again when they are visible.
+ *
+ * The budget bounds all the pictures of the plugin. A quarter of it goes to the
+ * shared decode cache and another quarter to the full screen viewer, both evict
+ * on their own; the labels and the pixmaps of TilePainter share the rest.
+ */
+class TileBudget {
+public:
+    static TileBudget* instance();
+
+    // budget in MB, 0 means no limit
+    void   setBudget(int mb);
+    int    budget() const;
+    qint64 used() const;
+
+    void insert(AspectRatioPixmapLabel* lbl, qint64 bytes);
+    void remove(AspectRatioPixmapLabel* lbl);
+    // lbl is visible now
+    void touch(AspectRatioPixmapLabel* lbl);
+    // pictures held outside the labels, negative when they are released; labels are evicted for them
+    void charge(qint64 bytes);
+
+    // MB the decode cache and the full screen viewer may each keep
+    int cacheBudget() const;
+
+private:
+    struct Entry {
+        qint64  bytes;
+        quint64 stamp;
+    };
+
+    // bytes the labels and the charges may use
+    qint64 limit() const;
+    void   evict(AspectRatioPixmapLabel* keep);
+
+    QHash<AspectRatioPixmapLabel*, Entry> entries_;
+    qint64                                budget_ = 0;
+    qint64                                used_   = 0;
+    quint64                               clock_  = 0;
+};
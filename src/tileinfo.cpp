@@ -0,0 +1,114 @@
+/* ============================================================
+ *
+ * This file is a part of digiKam flow plugin project
+ * https://github.com/cathaysia/digikamflowplugin
+ *
+ * Date        : 2021-05-22
+ * Description : Size and orientation of a picture, known before it is decoded.
+ *
+ * Copyright (C) 2021-2022 by DragonBillow <DragonBillow at outlook dot com>
+ *
+ * Redistribution and use is allowed according to the terms of the GPL3 license.
+ * For details see the accompanying LICENSE file.
+ *
+ * ============================================================ */
+
+#include "tileinfo.hpp"
+
+#include <QDateTime>
+#include <QFileInfo>
+#include <QImageIOHandler>
+#include <QImageReader>
+#include <QtMath>
+
+// EXIF orientation 5~8 rotate the picture by 90 or 270 degree
+inline bool isTransposed(int orientation) {
+    return orientation >= 5 && orientation <= 8;
+}
+
+inline int exifOrientation(QImageIOHandler::Transformations t) {
+    switch(int(t)) {
+        case QImageIOHandler::TransformationMirror: return 2;
+        case QImageIOHandler::TransformationRotate180: return 3;
+        case QImageIOHandler::TransformationFlip: return 4;
+        case QImageIOHandler::TransformationMirrorAndRotate90: return 5;
+        case QImageIOHandler::TransformationRotate90: return 6;
+        case QImageIOHandler::TransformationFlipAndRotate90: return 7;
+        case QImageIOHandler::TransformationRotate270: return 8;
+        default: return 1;
+    }
+}
+
+TileInfo TileInfo::fromHeader(QUrl const& url) {
+    TileInfo     info;
+    QImageReader reader(url.toLocalFile());
+    info.url         = url;
+    info.size        = reader.size();
+    info.orientation = exifOrientation(reader.transformation());
+    if(isTransposed(info.orientation)) info.size.transpose();
+    // the file is touched anyway
+    info.stamp();
+    return info;
+}
+
+TileInfo TileInfo::fromInfoMap(QUrl const& url, Digikam::DInfoInterface::DInfoMap const& map) {
+    QSize size = map.value(QLatin1String("dimensions")).toSize();
+    if(size.isEmpty()) return fromHeader(url);
+
+    TileInfo info;
+    info.url         = url;
+    info.size        = size;
+    info.orientation = map.value(QLatin1String("orientation"), 1).toInt();
+    if(isTransposed(info.orientation)) info.size.transpose();
+    return info;
+}
+
+void TileInfo::stamp() {
+    QFileInfo file(url.toLocalFile());
+    modified = file.exists() ? file.lastModified().toMSecsSinceEpoch() : -1;
+    bytes    = file.exists() ? file.size() : -1;
+}
+
+int TileInfo::levelFor(int edge) {
+    int level = 256;
+    while(level < edge && level < 2048) level *= 2;
+    return level;
+}
+
+int TileInfo::levelFor(QSize const& source, QSize const& tile, qreal dpr) {
+    if(source.isEmpty()) return levelFor(qCeil(qMax(tile.width(), tile.height()) * dpr));
+
+    // the label crops the picture, so it must cover the tile in both directions
+    qreal scale = qMax(qreal(tile.width()) / source.width(), qreal(tile.height()) / source.height());
+    int   edge  = qMax(source.width(), source.height());
+    return qMin(levelFor(qCeil(edge * scale * dpr)), levelFor(edge));
+}
+
+QImage TileInfo::oriented(QImage const& img, int orientation) {
+    switch(orientation) {
+        case 2: return img.mirrored(true, false);
+        case 3: return img.mirrored(true, true);
+        case 4: return img.mirrored(false, true);
+        case 5: return img.transformed(QTransform().rotate(90)).mirrored(true, false);
+        case 6: return img.transformed(QTransform().rotate(90));
+        case 7: return img.transformed(QTransform().rotate(90)).mirrored(false, true);
+        case 8: return img.transformed(QTransform().rotate(270));
+        default: return img;
+    }
+}
+
+QTransform TileInfo::orientationMatrix(int orientation, QSize const& source) {
+    qreal w = source.width(), h = source.height();
+    // clang-format off
+    switch(orientation) {
+        case 2: return QTransform(-1,  0,  0,  1, w, 0);
+        case 3: return QTransform(-1,  0,  0, -1, w, h);
+        case 4: return QTransform( 1,  0,  0, -1, 0, h);
+        case 5: return QTransform( 0,  1,  1,  0, 0, 0);
+        case 6: return QTransform( 0,  1, -1,  0, h, 0);
+        case 7: return QTransform( 0, -1, -1,  0, h, w);
+        case 8: return QTransform( 0, -1,  1,  0, 0, w);
+        default: return QTransform();
+    }
+    // clang-format on
+}
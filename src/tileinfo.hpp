@@ -0,0 +1,51 @@
+/* ============================================================
+ *
+ * This file is a part of digiKam flow plugin project
+ * https://github.com/cathaysia/digikamflowplugin
+ *
+ * Date        : 2021-05-22
+ * Description : Size and orientation of a picture, known before it is decoded.
+ *
+ * Copyright (C) 2021-2022 by DragonBillow <DragonBillow at outlook dot com>
+ *
+ * Redistribution and use is allowed according to the terms of the GPL3 license.
+ * For details see the accompanying LICENSE file.
+ *
+ * ============================================================ */
+
+#pragma once
+
+#include <QImage>
+#include <QSize>
+#include <QTransform>
+#include <QUrl>
+
+#include "dinfointerface.h"
+
+struct TileInfo {
+    QUrl url;
+    // size after the EXIF orientation is applied
+    QSize size;
+    // EXIF orientation, 1 is normal
+    int orientation = 1;
+    // mtime in ms and size of the file, -1 when not known yet; ThumbCache keys on them
+    qint64 modified = -1;
+    qint64 bytes    = -1;
+
+    // read from the image header only, no pixels are decoded
+    static TileInfo fromHeader(QUrl const& url);
+    // read from digikam's database, fallback to the image header
+    static TileInfo fromInfoMap(QUrl const& url, Digikam::DInfoInterface::DInfoMap const& map);
+    // fill modified and bytes from the file
+    void stamp();
+
+    // Pictures are decoded at levels of 256, 512, 1024 and 2048 pixels on the longest edge
+    static int levelFor(int edge);
+    // the smallest level covering a tile, never bigger than the picture itself
+    static int levelFor(QSize const& source, QSize const& tile, qreal dpr);
+
+    // apply an EXIF orientation to pixels which were decoded without it
+    static QImage oriented(QImage const& img, int orientation);
+    // maps the pixels of a picture of size source, as stored, to where oriented() puts them
+    static QTransform orientationMatrix(int orientation, QSize const& source);
+};
@@ -0,0 +1,205 @@
+/* ============================================================
+ *
+ * This file is a part of digiKam flow plugin project
+ * https://github.com/cathaysia/digikamflowplugin
+ *
+ * Date        : 2021-05-22
+ * Description : Flow geometry computed from picture sizes only.
+ *
+ * Copyright (C) 2021-2022 by DragonBillow <DragonBillow at outlook dot com>
+ *
+ * Redistribution and use is allowed according to the terms of the GPL3 license.
+ * For details see the accompanying LICENSE file.
+ *
+ * ============================================================ */
+
+#include "tilelayout.hpp"
+
+#include <algorithm>
+
+// width / height, pictures without a known size are treated as squares
+inline qreal aspectRatio(QSize const& size) {
+    if(size.width() <= 0 || size.height() <= 0) return 1;
+    return qreal(size.width()) / size.height();
+}
+
+TileLayout::Style TileLayout::styleFromName(QString const& name) {
+    if(name == QLatin1String("Row")) return Style::Row;
+    if(name == QLatin1String("Square")) return Style::Square;
+    return Style::Col;
+}
+
+void TileLayout::setStyle(Style style) {
+    if(style_ != style) valid_ = 0;
+    style_ = style;
+}
+
+TileLayout::Style TileLayout::style() const {
+    return style_;
+}
+
+void TileLayout::setSpacing(int spacing) {
+    spacing = std::max(spacing, 0);
+    if(spacing_ != spacing) valid_ = 0;
+    spacing_ = spacing;
+}
+
+int TileLayout::spacing() const {
+    return spacing_;
+}
+
+void TileLayout::setReferenceWidth(qreal width) {
+    width = std::max<qreal>(width, 1);
+    if(!qFuzzyCompare(refWidth_, width)) valid_ = 0;
+    refWidth_ = width;
+}
+
+qreal TileLayout::referenceWidth() const {
+    return refWidth_;
+}
+
+void TileLayout::setWidth(int width) {
+    width = std::max(width, 0);
+    if(width_ != width) valid_ = 0;
+    width_ = width;
+}
+
+int TileLayout::width() const {
+    return width_;
+}
+
+void TileLayout::clear() {
+    sizes_.clear();
+    rects_.clear();
+    columns_.clear();
+    justified_.clear();
+    laid_   = 0;
+    height_ = 0;
+    valid_  = 0;
+}
+
+int TileLayout::append(QSize const& size) {
+    sizes_.append(size);
+    justified_.append(aspectRatio(size));
+    return sizes_.count() - 1;
+}
+
+void TileLayout::setSize(int index, QSize const& size) {
+    if(index < 0 || index >= sizes_.count()) return;
+    sizes_[index] = size;
+    justified_.setRatio(index, aspectRatio(size));
+    // squares do not depend on the size, the others can not resume from the middle
+    if(style_ != Style::Square) valid_ = 0;
+}
+
+QSize TileLayout::size(int index) const {
+    return sizes_.value(index);
+}
+
+int TileLayout::count() const {
+    return sizes_.count();
+}
+
+QRect TileLayout::rect(int index) const {
+    if(index < 0 || index >= rects_.count()) return QRect();
+    return rects_.at(index);
+}
+
+int TileLayout::height() const {
+    return height_;
+}
+
+QVector<int> TileLayout::indicesIn(QRect const& region) const {
+    QVector<int> result;
+    // the bottoms only grow along a run of tiles, so bisect to the first one reaching the region
+    auto scan = [&](auto const& at, int count) {
+        int first = 0, last = count;
+        while(first < last) {
+            int middle = (first + last) / 2;
+            if(rects_.at(at(middle)).bottom() < region.top())
+                first = middle + 1;
+            else
+                last = middle;
+        }
+        for(int i = first; i < count && rects_.at(at(i)).top() <= region.bottom(); ++i)
+            if(rects_.at(at(i)).intersects(region)) result.append(at(i));
+    };
+
+    // Row and Square go row by row, Col column by column
+    if(laidStyle_ != Style::Col) {
+        scan([](int i) { return i; }, laid_);
+        return result;
+    }
+    for(auto const& column: columns_) scan([&column](int i) { return column.at(i); }, column.count());
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+void TileLayout::update() {
+    rects_.resize(sizes_.count());
+    if(width_ <= 0) {
+        height_ = 0;
+        return;
+    }
+    if(!valid_) {
+        heights_.fill(0, style_ == Style::Col ? columnCount() : 0);
+        columns_.fill(QVector<int>(), heights_.count());
+        height_ = 0;
+    }
+    if(valid_ >= sizes_.count()) return;
+
+    switch(style_) {
+        case Style::Row: updateRow(); break;
+        case Style::Col: updateCol(); break;
+        case Style::Square: updateSquare(); break;
+    }
+    laid_      = valid_;
+    laidStyle_ = style_;
+}
+
+bool TileLayout::isDirty() const {
+    return width_ > 0 && (valid_ < sizes_.count() || rects_.count() != sizes_.count());
+}
+
+bool TileLayout::sameSettings(TileLayout const& other) const {
+    return style_ == other.style_ && spacing_ == other.spacing_ && qFuzzyCompare(refWidth_, other.refWidth_)
+           && width_ == other.width_;
+}
+
+int TileLayout::columnCount() const {
+    return std::max(1, int((width_ + spacing_) / (refWidth_ + spacing_)));
+}
+
+// Justified rows, the breaks of all rows are chosen together. JustifiedLayout keeps
+// the costs of the rows before an append, so only the new tail is solved again
+void TileLayout::updateRow() {
+    justified_.setWidth(width_);
+    justified_.setSpacing(spacing_);
+    justified_.setReferenceHeight(refWidth_);
+    height_ = justified_.update(rects_);
+    valid_  = sizes_.count();
+}
+
+// Waterfall columns: every picture goes to the shortest column
+void TileLayout::updateCol() {
+    int colW = std::max(1, (width_ - spacing_ * (heights_.count() - 1)) / heights_.count());
+    for(int i = valid_; i < sizes_.count(); ++i) {
+        int c = int(std::min_element(heights_.begin(), heights_.end()) - heights_.begin());
+        int h = std::max(1, qRound(colW / aspectRatio(sizes_.at(i))));
+        rects_[i] = QRect(c * (colW + spacing_), heights_[c], colW, h);
+        heights_[c] += h + spacing_;
+        columns_[c].append(i);
+    }
+    valid_  = sizes_.count();
+    height_ = *std::max_element(heights_.begin(), heights_.end()) - spacing_;
+}
+
+void TileLayout::updateSquare() {
+    int cols = columnCount();
+    int side = std::max(1, (width_ - spacing_ * (cols - 1)) / cols);
+    for(int i = valid_; i < sizes_.count(); ++i)
+        rects_[i] = QRect((i % cols) * (side + spacing_), (i / cols) * (side + spacing_), side, side);
+    int rows = (sizes_.count() + cols - 1) / cols;
+    valid_   = sizes_.count();
+    height_  = rows * (side + spacing_) - spacing_;
+}
@@ -0,0 +1,88 @@
+/* ============================================================
+ *
+ * This file is a part of digiKam flow plugin project
+ * https://github.com/cathaysia/digikamflowplugin
+ *
+ * Date        : 2021-05-22
+ * Description : Flow geometry computed from picture sizes only.
+ *
+ * Copyright (C) 2021-2022 by DragonBillow <DragonBillow at outlook dot com>
+ *
+ * Redistribution and use is allowed according to the terms of the GPL3 license.
+ * For details see the accompanying LICENSE file.
+ *
+ * ============================================================ */
+
+#pragma once
+
+#include <QRect>
+#include <QSize>
+#include <QString>
+#include <QVector>
+
+#include "justifiedlayout.hpp"
+
+/**
+ * TileLayout places tiles the same way Z::FlowLayout does, but it only needs
+ * the size of every picture, not a widget. So the geometry of a whole album
+ * can be known before any picture is loaded.
+ *
+ * It is a value, copies share their arrays until one of them changes, so a
+ * copy can be updated on another thread while the original stays on screen.
+ */
+class TileLayout {
+public:
+    enum class Style { Row, Col, Square };
+    static Style styleFromName(QString const& name);
+
+    void  setStyle(Style style);
+    Style style() const;
+    void  setSpacing(int spacing);
+    int   spacing() const;
+    void  setReferenceWidth(qreal width);
+    qreal referenceWidth() const;
+    void  setWidth(int width);
+    int   width() const;
+
+    void  clear();
+    int   append(QSize const& size);
+    void  setSize(int index, QSize const& size);
+    QSize size(int index) const;
+    int   count() const;
+
+    QRect        rect(int index) const;
+    int          height() const;
+    // in index order, a bisection of the rows or columns finds the first one
+    QVector<int> indicesIn(QRect const& region) const;
+
+    // compute rects, after appending only the unfinished tail is recomputed
+    void update();
+    // update() has work to do
+    bool isDirty() const;
+    // same style, spacing, reference width and width
+    bool sameSettings(TileLayout const& other) const;
+
+private:
+    void updateRow();
+    void updateCol();
+    void updateSquare();
+    int  columnCount() const;
+
+    Style          style_    = Style::Col;
+    int            spacing_  = 3;
+    qreal          refWidth_ = 300;
+    int            width_    = 0;
+    int            height_   = 0;
+    QVector<QSize> sizes_;
+    QVector<QRect> rects_;
+    // rects before valid_ are final, heights_ is where Col resumes from
+    int          valid_ = 0;
+    QVector<int> heights_;
+    // the indexes in each column of Col, top to bottom
+    QVector<QVector<int>> columns_;
+    // the rects before laid_ were computed together in laidStyle_, indicesIn() searches them
+    int   laid_      = 0;
+    Style laidStyle_ = Style::Col;
+    // aspect ratios of sizes_, Row breaks its rows with it
+    JustifiedLayout justified_;
+};
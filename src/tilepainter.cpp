@@ -0,0 +1,110 @@
+/* ============================================================
+ *
+ * This file is a part of digiKam flow plugin project
+ * https://github.com/cathaysia/digikamflowplugin
+ *
+ * Date        : 2021-05-22
+ * Description : Paints the tiles of a flow view without a widget per tile.
+ *
+ * Copyright (C) 2021-2022 by DragonBillow <DragonBillow at outlook dot com>
+ *
+ * Redistribution and use is allowed according to the terms of the GPL3 license.
+ * For details see the accompanying LICENSE file.
+ *
+ * ============================================================ */
+
+#include "tilepainter.hpp"
+
+#include <QElapsedTimer>
+#include <QPainter>
+
+#include "profiler.hpp"
+#include "resampler.hpp"
+#include "tilebudget.hpp"
+#include "tileinfo.hpp"
+
+TilePainter::~TilePainter() {
+    clear();
+}
+
+void TilePainter::setBudget(int ms) {
+    budget_ = qMax(ms, 1);
+}
+
+int TilePainter::budget() const {
+    return budget_;
+}
+
+void TilePainter::setImage(int index, QImage const& img, bool preview) {
+    if(img.isNull()) return;
+    auto& entry = entries_[index];
+    if(preview && !entry.img.isNull()) return;
+    entry.img     = img;
+    entry.preview = preview;
+    entry.dirty   = true;
+    // the old pixmap is still stretched over the tile until the new one is scaled
+    account(entry);
+}
+
+QImage TilePainter::image(int index) const {
+    return entries_.value(index).img;
+}
+
+int TilePainter::level(int index) const {
+    auto it = entries_.constFind(index);
+    if(it == entries_.constEnd() || it->preview || it->img.isNull()) return 0;
+    return TileInfo::levelFor(qMax(it->img.width(), it->img.height()));
+}
+
+void TilePainter::remove(int index) {
+    auto it = entries_.find(index);
+    if(it == entries_.end()) return;
+    TileBudget::instance()->charge(-it->bytes);
+    entries_.erase(it);
+}
+
+void TilePainter::clear() {
+    qint64 bytes = 0;
+    for(auto& entry: entries_) bytes += entry.bytes;
+    TileBudget::instance()->charge(-bytes);
+    entries_.clear();
+}
+
+bool TilePainter::paint(QPainter& painter, QVector<Tile> const& tiles, qreal dpr) {
+    QElapsedTimer timer;
+    timer.start();
+    bool complete = true;
+
+    for(auto& tile: tiles) {
+        auto it = entries_.find(tile.index);
+        if(it == entries_.end() || it->img.isNull()) {
+            painter.fillRect(tile.rect, QColor(tile.color));
+            continue;
+        }
+
+        // a pixmap of another picture or size is stale, but better than nothing while over budget
+        QSize target = tile.rect.size() * dpr;
+        bool  stale  = it->dirty || it->pix.isNull() || it->pix.size() != target;
+        if(stale && timer.elapsed() < budget_) {
+            Profiler::Scope scope("scale", tile.index);
+            it->pix = QPixmap::fromImage(Resampler::cropped(it->img, target));
+            it->pix.setDevicePixelRatio(dpr);
+            it->dirty = false;
+            stale     = false;
+            account(*it);
+        }
+        if(stale) complete = false;
+
+        if(it->pix.isNull()) painter.fillRect(tile.rect, QColor(tile.color));
+        else
+            painter.drawPixmap(tile.rect, it->pix);
+    }
+    return complete;
+}
+
+void TilePainter::account(Entry& entry) {
+    qint64 bytes = qint64(entry.img.bytesPerLine()) * entry.img.height()
+                 + qint64(entry.pix.width()) * entry.pix.height() * entry.pix.depth() / 8;
+    TileBudget::instance()->charge(bytes - entry.bytes);
+    entry.bytes = bytes;
+}
@@ -0,0 +1,77 @@
+/* ============================================================
+ *
+ * This file is a part of digiKam flow plugin project
+ * https://github.com/cathaysia/digikamflowplugin
+ *
+ * Date        : 2021-05-22
+ * Description : Paints the tiles of a flow view without a widget per tile.
+ *
+ * Copyright (C) 2021-2022 by DragonBillow <DragonBillow at outlook dot com>
+ *
+ * Redistribution and use is allowed according to the terms of the GPL3 license.
+ * For details see the accompanying LICENSE file.
+ *
+ * ============================================================ */
+
+#pragma once
+
+#include <QColor>
+#include <QHash>
+#include <QImage>
+#include <QPixmap>
+#include <QRect>
+#include <QVector>
+
+class QPainter;
+
+/**
+ * TilePainter keeps the pictures of the tiles near the viewport, and a pixmap
+ * of each at the size of its tile. A paint only blits those pixmaps. Scaling
+ * a picture to its tile is the expensive part, so one paint scales as many as
+ * its time budget allows; the other tiles show their old pixmap stretched or
+ * their placeholder color, and the next frame goes on where this one stopped.
+ *
+ * The pictures and pixmaps are charged to TileBudget.
+ */
+class TilePainter {
+public:
+    struct Tile {
+        int   index;
+        QRect rect;
+        QRgb  color;
+    };
+
+    ~TilePainter();
+
+    // milliseconds one paint may spend on scaling
+    void setBudget(int ms);
+    int  budget() const;
+
+    // a preview is kept until the final picture arrives, it is ignored after that
+    void   setImage(int index, QImage const& img, bool preview);
+    QImage image(int index) const;
+    // level of the final picture, 0 without one
+    int  level(int index) const;
+    void remove(int index);
+    void clear();
+
+    // false when some tiles were not scaled in the budget, paint again next frame
+    bool paint(QPainter& painter, QVector<Tile> const& tiles, qreal dpr);
+
+private:
+    struct Entry {
+        QImage  img;
+        bool    preview = false;
+        QPixmap pix;
+        // pix was scaled from an older picture
+        bool dirty = false;
+        // charged to TileBudget
+        qint64 bytes = 0;
+    };
+
+    // charge the change of the size of entry
+    void account(Entry& entry);
+
+    QHash<int, Entry> entries_;
+    int               budget_ = 6;
+};
@@ -0,0 +1,267 @@
+/* ============================================================
+ *
+ * This file is a part of digiKam flow plugin project
+ * https://github.com/cathaysia/digikamflowplugin
+ *
+ * Date        : 2021-05-22
+ * Description : Unit tests of JustifiedLayout and TileLayout.
+ *
+ * Copyright (C) 2021-2022 by DragonBillow <DragonBillow at outlook dot com>
+ *
+ * Redistribution and use is allowed according to the terms of the GPL3 license.
+ * For details see the accompanying LICENSE file.
+ *
+ * ============================================================ */
+
+/**
+ * layouttest checks the layouts against brute force and against each other,
+ * prints every failed check and exits with the number of failures.
+ */
+
+#include <QElapsedTimer>
+#include <QRect>
+#include <QVector>
+#include <QtGlobal>
+#include <QtMath>
+
+#include <algorithm>
+#include <limits>
+#include <random>
+
+#include "justifiedlayout.hpp"
+#include "tilelayout.hpp"
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(condition)                                                         \
+    do {                                                                         \
+        if(!(condition)) {                                                       \
+            qWarning("%s:%d: CHECK(%s) failed", __FILE__, __LINE__, #condition); \
+            ++failures;                                                          \
+        }                                                                        \
+    } while(0)
+
+// same as JustifiedLayout, a row is never shorter than half the reference unless it holds one picture
+constexpr double kMinScale = 0.5;
+
+struct Params {
+    int    width;
+    int    spacing;
+    double ref;
+};
+
+JustifiedLayout makeLayout(QVector<double> const& ratios, Params const& p) {
+    JustifiedLayout layout;
+    layout.setWidth(p.width);
+    layout.setSpacing(p.spacing);
+    layout.setReferenceHeight(p.ref);
+    for(double ratio: ratios) layout.append(ratio);
+    return layout;
+}
+
+// the cost JustifiedLayout minimizes for the rows beginning at starts, infinite when a row is not allowed
+double cost(QVector<double> const& ratios, QVector<int> const& starts, Params const& p) {
+    double total = 0;
+    for(int r = 0; r < starts.count(); ++r) {
+        int    begin = starts.at(r);
+        int    end   = r + 1 < starts.count() ? starts.at(r + 1) : ratios.count();
+        double sum   = 0;
+        // the layout keeps the ratios as float
+        for(int i = begin; i < end; ++i) sum += float(ratios.at(i));
+        double gaps   = p.spacing * (end - begin - 1);
+        double height = p.width - gaps > 0 ? (p.width - gaps) / sum : 0;
+        bool   last   = end == ratios.count();
+        // the last row is free when it fits unstretched
+        if(last && sum * p.ref + gaps <= p.width) continue;
+        if(end - begin > 1 && height < p.ref * kMinScale) return std::numeric_limits<double>::infinity();
+        double d = (height - p.ref) / p.ref;
+        total += d * d;
+    }
+    return total;
+}
+
+double bruteForce(QVector<double> const& ratios, Params const& p) {
+    int    n    = ratios.count();
+    double best = std::numeric_limits<double>::infinity();
+    for(int mask = 0; mask < (1 << (n - 1)); ++mask) {
+        QVector<int> starts { 0 };
+        for(int i = 1; i < n; ++i)
+            if(mask & (1 << (i - 1))) starts.append(i);
+        best = std::min(best, cost(ratios, starts, p));
+    }
+    return best;
+}
+
+QVector<double> randomRatios(std::mt19937& rng, int count) {
+    static double const choices[] = { 4 / 3., 3 / 2., 16 / 9., 1, 2 / 3., 3 / 4., 3, 1 / 3. };
+    QVector<double>     ratios;
+    for(int i = 0; i < count; ++i) ratios.append(choices[rng() % 8]);
+    return ratios;
+}
+
+QVector<QRect> rectsOf(JustifiedLayout& layout) {
+    QVector<QRect> rects;
+    layout.update(rects);
+    return rects;
+}
+
+void testOptimalBreaks() {
+    std::mt19937 rng(1);
+    for(int run = 0; run < 500; ++run) {
+        QVector<double> ratios = randomRatios(rng, 1 + int(rng() % 11));
+        Params          p { 200 + int(rng() % 1200), int(rng() % 6), 100. + rng() % 250 };
+        JustifiedLayout layout = makeLayout(ratios, p);
+        rectsOf(layout);
+        double found    = cost(ratios, layout.rowStarts(), p);
+        double expected = bruteForce(ratios, p);
+        CHECK(qAbs(found - expected) <= 1e-9 * std::max(1., expected));
+    }
+}
+
+void testAppendMatchesFullSolve() {
+    std::mt19937 rng(2);
+    for(int run = 0; run < 50; ++run) {
+        QVector<double> ratios = randomRatios(rng, 1 + int(rng() % 300));
+        Params          p { 300 + int(rng() % 1500), int(rng() % 6), 80. + rng() % 300 };
+        JustifiedLayout full = makeLayout(ratios, p);
+
+        JustifiedLayout step = makeLayout(QVector<double>(), p);
+        QVector<QRect>  rects;
+        for(double ratio: ratios) {
+            step.append(ratio);
+            step.update(rects);
+        }
+        CHECK(rects == rectsOf(full));
+        CHECK(step.rowStarts() == full.rowStarts());
+    }
+}
+
+void testSetRatioInvalidatesTail() {
+    std::mt19937 rng(3);
+    for(int run = 0; run < 50; ++run) {
+        QVector<double> ratios = randomRatios(rng, 2 + int(rng() % 200));
+        Params          p { 300 + int(rng() % 1500), int(rng() % 6), 80. + rng() % 300 };
+        JustifiedLayout layout = makeLayout(ratios, p);
+        rectsOf(layout);
+
+        int index     = int(rng() % ratios.count());
+        ratios[index] = randomRatios(rng, 1).first();
+        layout.setRatio(index, ratios.at(index));
+        JustifiedLayout fresh = makeLayout(ratios, p);
+        CHECK(rectsOf(layout) == rectsOf(fresh));
+    }
+}
+
+void testLastRow() {
+    // fits: the reference height, not stretched
+    JustifiedLayout short_ = makeLayout({ 1, 1, 1 }, { 1000, 4, 100 });
+    QVector<QRect>  rects  = rectsOf(short_);
+    CHECK(short_.rowStarts() == QVector<int>({ 0 }));
+    for(auto& rect: rects) CHECK(rect.height() == 100 && rect.width() == 100);
+    CHECK(rects.last().right() < 1000 - 1);
+
+    // the last picture alone is wider than a row: every row, the last one too, ends at the right edge
+    JustifiedLayout wide = makeLayout({ 2, 2, 2, 2, 2, 2, 20 }, { 1000, 4, 100 });
+    rects                = rectsOf(wide);
+    QVector<int> starts  = wide.rowStarts();
+    for(int r = 0; r < starts.count(); ++r) {
+        int end = r + 1 < starts.count() ? starts.at(r + 1) : rects.count();
+        CHECK(rects.at(end - 1).right() == 1000 - 1);
+    }
+}
+
+void testNarrowerThanOnePicture() {
+    for(int width: { 1, 2, 10, 50 }) {
+        JustifiedLayout layout = makeLayout({ 1.5, 1, 3, 0.5, 2 }, { width, 3, 300 });
+        QVector<QRect>  rects  = rectsOf(layout);
+        // every picture gets its own row, inside the width, never empty
+        CHECK(layout.rowStarts().count() == rects.count());
+        for(auto& rect: rects) {
+            CHECK(!rect.isEmpty());
+            CHECK(rect.x() == 0 && rect.right() < std::max(width, 1));
+        }
+        for(int i = 1; i < rects.count(); ++i) CHECK(rects.at(i).top() > rects.at(i - 1).bottom());
+    }
+}
+
+// the window of row starts does not grow with the album, so neither do the candidates weighed per picture;
+// the timings are only printed, layoutbench measures them
+void testLinearPass() {
+    std::mt19937 rng(4);
+    double       perPicture[2];
+    int          counts[2] = { 10000, 100000 };
+    for(int i = 0; i < 2; ++i) {
+        JustifiedLayout layout = makeLayout(randomRatios(rng, counts[i]), { 1280, 3, 300 });
+        QElapsedTimer   timer;
+        timer.start();
+        rectsOf(layout);
+        qWarning("JustifiedLayout: %d pictures in %.2f ms, %lld candidates", counts[i], timer.nsecsElapsed() / 1e6,
+                 layout.candidates());
+        perPicture[i] = double(layout.candidates()) / counts[i];
+        CHECK(perPicture[i] < 64);
+    }
+    CHECK(perPicture[1] < perPicture[0] * 1.1);
+
+    // appending one picture weighs the candidates of that picture only
+    JustifiedLayout layout = makeLayout(randomRatios(rng, 100000), { 1280, 3, 300 });
+    rectsOf(layout);
+    layout.append(1.5);
+    rectsOf(layout);
+    CHECK(layout.candidates() < 2 * 256);
+}
+
+void testRowHeights() {
+    std::mt19937 rng(6);
+    for(int run = 0; run < 50; ++run) {
+        QVector<double> ratios = randomRatios(rng, 1 + int(rng() % 500));
+        Params          p { 200 + int(rng() % 1500), int(rng() % 6), 80. + rng() % 300 };
+        JustifiedLayout layout = makeLayout(ratios, p);
+        QVector<QRect>  rects  = rectsOf(layout);
+        QVector<int>    starts = layout.rowStarts();
+        // a row of several pictures keeps half the reference height, give or take the rounding to pixels
+        for(int r = 0; r < starts.count(); ++r) {
+            int end = r + 1 < starts.count() ? starts.at(r + 1) : rects.count();
+            if(end - starts.at(r) > 1) CHECK(rects.at(starts.at(r)).height() >= qFloor(p.ref * kMinScale));
+        }
+    }
+}
+
+void testIndicesIn() {
+    std::mt19937 rng(5);
+    for(int run = 0; run < 150; ++run) {
+        TileLayout layout;
+        layout.setStyle(TileLayout::Style(run % 3));
+        layout.setSpacing(int(rng() % 5));
+        layout.setReferenceWidth(100 + rng() % 200);
+        layout.setWidth(300 + int(rng() % 1500));
+        int count = 1 + int(rng() % 500);
+        for(int i = 0; i < count; ++i) layout.append(QSize(50 + int(rng() % 400), 50 + int(rng() % 400)));
+        layout.update();
+
+        for(int query = 0; query < 40; ++query) {
+            QRect region(int(rng() % layout.width()), int(rng() % (layout.height() + 100)) - 50,
+                         1 + int(rng() % 800), 1 + int(rng() % 800));
+            QVector<int> expected;
+            for(int i = 0; i < layout.count(); ++i)
+                if(layout.rect(i).intersects(region)) expected.append(i);
+            CHECK(layout.indicesIn(region) == expected);
+        }
+    }
+}
+
+}    // namespace
+
+int main() {
+    testOptimalBreaks();
+    testAppendMatchesFullSolve();
+    testSetRatioInvalidatesTail();
+    testLastRow();
+    testNarrowerThanOnePicture();
+    testLinearPass();
+    testRowHeights();
+    testIndicesIn();
+    if(failures) qWarning("%d checks failed", failures);
+    return failures ? 1 : 0;
+}